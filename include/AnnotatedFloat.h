@@ -19,10 +19,9 @@ union AnnotatedFloat {
   AnnotatedFloat() = default;
   explicit constexpr AnnotatedFloat(float f) : f(f) {}
 
-  explicit AnnotatedFloat(const char *msg) : f(NAN) {
-    fraction = 0;
-    for (int i = 0; i < 3 && msg[i]; i++) fraction |= msg[i] << (i * 8);
-  }
+  // a quiet NaN with the annotation in the fraction bits, constexpr to allow annotations in constant initializers
+  explicit constexpr AnnotatedFloat(const char *msg)
+      : fraction(annotation(msg)), signaling(1), exponent(0xff), sign(0) {}
 
   void getAnnotation(char *msg) const {
     for (uint32_t fraction = isnan(f) ? this->fraction : 0, i = 0; i < 3; i++, fraction >>= 8)
@@ -30,6 +29,12 @@ union AnnotatedFloat {
     msg[3] = 0;
   }
 
+  static constexpr uint32_t annotation(const char *msg) {
+    uint32_t fraction = 0;
+    for (int i = 0; i < 3 && msg[i]; i++) fraction |= uint32_t(uint8_t(msg[i])) << (i * 8);
+    return fraction;
+  }
+
   bool operator==(const AnnotatedFloat &o) const {
     if (isnan(f) && isnan(o.f)) return fraction == o.fraction && signaling == o.signaling && sign == o.sign;
     return f == o.f;
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <Arduino.h>
+#include <Arduino_FreeRTOS.h>
+
+namespace blastic {
+
+namespace boot {
+
+/*
+  Milliseconds since reset at the end of each boot phase, to track the time to the first weight shown. A phase is
+  recorded only the first time it is marked, unmarked phases read 0.
+*/
+
+enum class Phase : uint8_t {
+  config,
+  tasks,
+  buttons,
+  setup,
+  scheduler,
+  tare,
+  weight,
+  time,
+  storage,
+  cmdboot,
+  ready,
+  host,
+  count
+};
+
+constexpr const char *phaseNames[]{"config", "tasks", "buttons", "setup", "scheduler", "tare", "weight",
+                                   "time", "storage", "cmdboot", "ready", "host"};
+static_assert(std::size(phaseNames) == size_t(Phase::count));
+
+void mark(Phase phase);
+uint32_t time(Phase phase);
+
+/*
+  The startup jobs run in parallel, each on its own task: the initial tare on the submitter task, which shows the weight
+  right after it; the Wi-Fi association and time sync on the Layer3 background task; the SD mount with the flash log
+  migration, then the cmdboot and cmdonce files, on the CLI task (they share the card). A job signals done() whether it
+  succeeded or not, which marks its phase, and the ready phase once all of them are done. Tasks that depend on a job
+  wait() for it.
+*/
+
+enum class Job : EventBits_t { tare = 1, time = 2, storage = 4, cmdboot = 8 };
+
+void done(Job job);
+// false on timeout
+bool wait(Job job, TickType_t timeout);
+
+/*
+  The boot does not wait for a host on the serial port. The text output goes to this console, which keeps it in a
+  buffer until Serial reports a host, then writes it out, and writes through from then on. Call watchHost() at the end
+  of setup() to flush it in the background when a host attaches later (the host phase). setup() writes to the console
+  directly, the tasks through the MSerial lock, which is the lock of the console. The output of a single task can be
+  redirected to another Print, which is how an RPC CALL captures the text of its command.
+*/
+
+class Console : public Print {
+  static constexpr const size_t bufferSize = 2048;
+  uint8_t buffer[bufferSize];
+  size_t length = 0, dropped = 0;
+  bool attached = false;
+  Print *redirected = nullptr;
+  TaskHandle_t redirectedTask;
+
+public:
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t size) override;
+  // write out the buffer if a host is attached, true if so
+  bool release();
+  // send the output of the calling task to output, until called with nullptr (take the MSerial lock to call)
+  void redirect(Print *output);
+};
+
+extern Console console;
+
+void watchHost();
+
+} // namespace boot
+
+} // namespace blastic
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include "blastic.h"
+#include "murmur32.h"
+#include "PerfectHash.h"
+
+namespace blastic {
+
+namespace eeprom {
+
+/*
+  The config schema: every field of Config, listed once. The list generates the descriptor table below, used by the
+  `get`/`set` accessors, sanitize() and the `config::dump` text export, and the conversion from older versions in
+  Config::operator=. Adding a field to Config takes a line here, plus a default in makeDefaults() if zero is not right.
+
+    field(name, path, minVersion, validator, flags)
+    element(name, array, index, path, minVersion, validator, flags)
+
+  name is the accessor address without the "config." prefix, path the member in Config, minVersion the config version
+  that introduced the field. element() is for members of std::array elements, which offsetof cannot index.
+*/
+
+#define BLASTIC_CONFIG_SCHEMA(field, element)                                                                          \
+  field("scale.dataPin", scale.dataPin, 0, DIGITAL_PIN, 0)                                                             \
+  field("scale.clockPin", scale.clockPin, 0, DIGITAL_PIN, 0)                                                           \
+  field("scale.mode", scale.mode, 0, NONE, 0)                                                                          \
+  BLASTIC_CONFIG_SCHEMA_CALIBRATION(element, "A128", 0)                                                                \
+  BLASTIC_CONFIG_SCHEMA_CALIBRATION(element, "B", 1)                                                                   \
+  BLASTIC_CONFIG_SCHEMA_CALIBRATION(element, "A64", 2)                                                                 \
+  field("wifi.ssid", wifi.ssid, 0, NONE, 0)                                                                            \
+  field("wifi.password", wifi.password, 0, NONE, 0)                                                                    \
+  field("wifi.dhcpTimeout", wifi.dhcpTimeout, 0, NONE, 0)                                                              \
+  field("wifi.idleTimeout", wifi.idleTimeout, 0, NONE, 0)                                                              \
+  BLASTIC_CONFIG_SCHEMA_ALTERNATE(field, "0", 0)                                                                       \
+  BLASTIC_CONFIG_SCHEMA_ALTERNATE(field, "1", 1)                                                                       \
+  BLASTIC_CONFIG_SCHEMA_ALTERNATE(field, "2", 2)                                                                       \
+  field("submit.threshold", submit.threshold, 0, POSITIVE, 0)                                                          \
+  field("submit.skipPPForm", submit.skipPPForm, 4, NONE, 0)                                                            \
+  field("submit.spacesWorkaroundPPForm", submit.spacesWorkaroundPPForm, 5, NONE, 0)                                    \
+  field("submit.collectionPoint", submit.collectionPoint, 0, NONE, Field::NOTIFY)                                      \
+  field("submit.collectorName", submit.collectorName, 0, NONE, Field::NOTIFY)                                          \
+  field("submit.userForm.urn", submit.userForm.urn, 0, NONE, 0)                                                        \
+  field("submit.userForm.type", submit.userForm.type, 0, NONE, 0)                                                      \
+  field("submit.userForm.collectionPoint", submit.userForm.collectionPoint, 0, NONE, 0)                                \
+  field("submit.userForm.collectorName", submit.userForm.collectorName, 0, NONE, 0)                                    \
+  field("submit.userForm.weight", submit.userForm.weight, 0, NONE, 0)                                                  \
+  field("submit.json.urn", submit.json.urn, 6, NONE, 0)                                                                \
+  field("submit.json.token", submit.json.token, 6, NONE, 0)                                                            \
+  field("submit.mqtt.host", submit.mqtt.host, 6, NONE, 0)                                                              \
+  field("submit.mqtt.port", submit.mqtt.port, 6, NONZERO, 0)                                                           \
+  field("submit.mqtt.topic", submit.mqtt.topic, 6, NONE, 0)                                                            \
+  field("submit.mqtt.clientId", submit.mqtt.clientId, 6, NONE, 0)                                                      \
+  field("submit.mqtt.username", submit.mqtt.username, 6, NONE, 0)                                                      \
+  field("submit.mqtt.password", submit.mqtt.password, 6, NONE, 0)                                                      \
+  BLASTIC_CONFIG_SCHEMA_BUTTON(element, "OK", 0)                                                                       \
+  BLASTIC_CONFIG_SCHEMA_BUTTON(element, "NEXT", 1)                                                                     \
+  BLASTIC_CONFIG_SCHEMA_BUTTON(element, "PREVIOUS", 2)                                                                 \
+  BLASTIC_CONFIG_SCHEMA_BUTTON(element, "BACK", 3)                                                                     \
+  field("ntp.hostname", ntp.hostname, 2, NONE, 0)                                                                      \
+  field("ntp.refresh", ntp.refresh, 3, NONE, 0)                                                                        \
+  field("sdcard.CSPin", sdcard.CSPin, 1, DIGITAL_PIN, 0)                                                               \
+  field("sdcard.syncRecords", sdcard.syncRecords, 8, NONE, 0)                                                          \
+  field("sdcard.syncSeconds", sdcard.syncSeconds, 8, NONE, 0)
+
+#define BLASTIC_CONFIG_SCHEMA_CALIBRATION(element, mode, index)                                                        \
+  element("scale.calibrations." mode ".tareRead", scale.calibrations, index, tareRead, 0, NONE, 0)                     \
+  element("scale.calibrations." mode ".calibrationRead", scale.calibrations, index, calibrationRead, 0, NONE, 0)       \
+  element("scale.calibrations." mode ".calibrationWeight", scale.calibrations, index, calibrationWeight, 0, NONE, 0)
+
+#define BLASTIC_CONFIG_SCHEMA_ALTERNATE(field, name, index)                                                            \
+  field("wifi.alternates." name ".ssid", wifi.alternates[index].ssid, 7, NONE, 0)                                      \
+  field("wifi.alternates." name ".password", wifi.alternates[index].password, 7, NONE, 0)
+
+#define BLASTIC_CONFIG_SCHEMA_BUTTON(element, name, index)                                                             \
+  element("buttons." name ".pin", buttons, index, pin, 0, DIGITAL_PIN, 0)                                              \
+  element("buttons." name ".threshold", buttons, index, threshold, 0, NONE, 0)                                         \
+  element("buttons." name ".div", buttons, index, settings.div, 0, NONE, 0)                                            \
+  element("buttons." name ".gain", buttons, index, settings.gain, 0, NONE, 0)                                          \
+  element("buttons." name ".ref_current", buttons, index, settings.ref_current, 0, NONE, 0)                            \
+  element("buttons." name ".offset", buttons, index, settings.offset, 0, NONE, 0)                                      \
+  element("buttons." name ".count", buttons, index, settings.count, 0, NONE, 0)
+
+namespace schema {
+
+using Config = blastic::Config;
+
+enum class FieldType : uint8_t {
+  BOOL,
+  UINT8,
+  UINT16,
+  UINT32,
+  INT32,
+  FLOAT,
+  ANNOTATED_FLOAT,
+  STRING,
+  HX711_MODE,
+  CTSU_GAIN,
+  CTSU_DIV
+};
+
+template <typename T> struct isStringBuffer : std::false_type {};
+template <size_t size> struct isStringBuffer<util::StringBuffer<size>> : std::true_type {};
+
+template <typename T> constexpr FieldType fieldType() {
+  if constexpr (std::is_same_v<T, bool>) return FieldType::BOOL;
+  else if constexpr (std::is_same_v<T, uint8_t>) return FieldType::UINT8;
+  else if constexpr (std::is_same_v<T, uint16_t>) return FieldType::UINT16;
+  else if constexpr (std::is_same_v<T, uint32_t>) return FieldType::UINT32;
+  else if constexpr (std::is_same_v<T, int32_t>) return FieldType::INT32;
+  else if constexpr (std::is_same_v<T, float>) return FieldType::FLOAT;
+  else if constexpr (std::is_same_v<T, util::AnnotatedFloat>) return FieldType::ANNOTATED_FLOAT;
+  else if constexpr (isStringBuffer<T>::value) return FieldType::STRING;
+  else if constexpr (std::is_same_v<T, scale::HX711Mode>) return FieldType::HX711_MODE;
+  else if constexpr (std::is_same_v<T, e_ctsu_ico_gain>) return FieldType::CTSU_GAIN;
+  else {
+    static_assert(std::is_same_v<T, ctsu_clock_div_t>, "add the type to FieldType");
+    return FieldType::CTSU_DIV;
+  }
+}
+
+struct Field {
+  enum Validator : uint8_t { NONE, DIGITAL_PIN, POSITIVE, NONZERO };
+  enum Flags : uint8_t { NOTIFY = 1 };
+
+  const char *name;
+  uint32_t nameHash;
+  uint16_t offset, size;
+  FieldType type;
+  Validator validator;
+  uint8_t minVersion, flags;
+
+  template <typename T>
+  static constexpr Field make(const char *name, size_t offset, uint8_t minVersion, Validator validator,
+                              uint8_t flags) {
+    return {name, util::murmur3_32(name), uint16_t(offset), uint16_t(sizeof(T)), fieldType<T>(), validator,
+            minVersion, flags};
+  }
+
+  // the field in a Config
+  void *in(Config &config) const { return reinterpret_cast<uint8_t *>(&config) + offset; }
+  const void *in(const Config &config) const { return reinterpret_cast<const uint8_t *>(&config) + offset; }
+};
+
+template <typename Array> using elementType = typename Array::value_type;
+
+#define BLASTIC_CONFIG_SCHEMA_FIELD(name, path, minVersion, validator, flags)                                          \
+  Field::make<decltype(std::declval<Config &>().path)>("config." name, offsetof(Config, path), minVersion,             \
+                                                       Field::validator, flags),
+#define BLASTIC_CONFIG_SCHEMA_ELEMENT(name, array, index, path, minVersion, validator, flags)                          \
+  Field::make<decltype(std::declval<Config &>().array[index].path)>(                                                   \
+      "config." name,                                                                                                  \
+      offsetof(Config, array) + index * sizeof(elementType<decltype(std::declval<Config &>().array)>) +                \
+          offsetof(elementType<decltype(std::declval<Config &>().array)>, path),                                       \
+      minVersion, Field::validator, flags),
+
+inline constexpr const Field fields[]{
+    BLASTIC_CONFIG_SCHEMA(BLASTIC_CONFIG_SCHEMA_FIELD, BLASTIC_CONFIG_SCHEMA_ELEMENT)};
+
+#undef BLASTIC_CONFIG_SCHEMA_FIELD
+#undef BLASTIC_CONFIG_SCHEMA_ELEMENT
+
+// the largest field, for buffers that hold a value of any field
+constexpr size_t maxFieldSize() {
+  size_t max = 0;
+  for (auto &field : fields) max = field.size > max ? field.size : max;
+  return max;
+}
+
+inline constexpr const util::PerfectHash fieldIndex(fields, &Field::nameHash);
+static_assert(fieldIndex.unique(), "config field names with the same hash");
+static_assert(fieldIndex.valid());
+
+// the field with the given name hash, nullptr if none
+inline const Field *find(uint32_t nameHash) { return fieldIndex.find(nameHash); }
+
+/*
+  Check a value of the field: enums in range, finite floats, terminated strings, and the field validator. Strings are
+  terminated and a negative threshold is made positive in place.
+*/
+bool validate(const Field &field, void *value);
+
+} // namespace schema
+
+} // namespace eeprom
+
+} // namespace blastic
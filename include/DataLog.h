@@ -0,0 +1,102 @@
+#pragma once
+
+#include "blastic.h"
+#include "SDCard.h"
+
+namespace blastic {
+
+/*
+  Append-only binary log of the measurements, in segment files LOG/<number>.BIN numbered from 1 without gaps. Each
+  segment starts with a SegmentHeader with the collection point and collector names, followed by fixed size Records.
+  A new segment is started when the names change, when a segment is full, or on the first record of a new (UTC) day.
+
+  Both sizes are multiples of 16 bytes, so that records never straddle an SD card sector: a power cut can only leave a
+  torn record at the end of the last segment, and the recovery on the first append after a mount truncates it by only
+  looking at the file size and at the last record checksum.
+*/
+
+namespace datalog {
+
+struct Record {
+  enum Flags : uint8_t { TIME_UNSET = 1 };
+
+  int32_t epoch;
+  float weight;
+  plastic type;
+  uint8_t flags;
+  // low bits of SegmentHeader::collector
+  uint16_t collector;
+  uint32_t crc;
+
+  uint32_t checksum() const { return util::crc32(this, offsetof(Record, crc)); }
+  bool valid() const { return crc == checksum(); }
+};
+
+static_assert(sizeof(Record) == 16);
+
+struct SegmentHeader {
+  static constexpr const uint32_t expectedSignature = ((uint32_t('B') << 8 | 'L') << 8 | 'S') << 8 | 'L';
+  static constexpr const uint16_t currentVersion = 1;
+
+  uint32_t signature;
+  uint16_t version, recordSize;
+  int32_t createdEpoch;
+  // hash of the names
+  uint32_t collector;
+  decltype(Submitter::Config<0>::collectionPoint) collectionPoint, collectorName;
+  uint8_t reserved[12];
+  uint32_t crc;
+
+  uint32_t checksum() const { return util::crc32(this, offsetof(SegmentHeader, crc)); }
+  bool valid() const {
+    return signature == expectedSignature && version == currentVersion && recordSize == sizeof(Record) &&
+           crc == checksum();
+  }
+};
+
+static_assert(sizeof(SegmentHeader) % sizeof(Record) == 0);
+
+constexpr const uint32_t maxSegmentRecords = 4096;
+
+// segment number and record index in the segment
+struct Position {
+  uint32_t segment, record;
+};
+
+/*
+  Sparse index of the log in LOG/INDEX.BIN: an entry for the first record of each segment, then one every indexInterval
+  records, with the record epoch. Records with the time unset are not indexed. Entries are in log order, and searched
+  assuming that epochs increase along the log, which holds as long as the clock is not set back.
+*/
+
+struct IndexEntry {
+  int32_t epoch;
+  Position position;
+};
+
+constexpr const uint32_t indexInterval = 128;
+
+uint32_t collectorHash(const char *collectionPoint, const char *collectorName);
+
+bool append(SDCard &sd, int32_t epoch, float weight, plastic type);
+
+// the last segment, 0 if the log is empty
+uint32_t lastSegment(SDCard &sd);
+
+// a position before the first record with an epoch not older than from, usually by less than indexInterval records
+Position find(SDCard &sd, int32_t from);
+
+// the position of the last n records
+Position tail(SDCard &sd, uint32_t n);
+
+/*
+  Read up to max valid records from position, which is advanced past the records read, also past those with a bad
+  checksum. At the end of a segment position moves to the start of the next one, but the records of a single call
+  always come from a single segment, whose header is stored in header if not null. Returns -1 at the end of the log or
+  on errors.
+*/
+int read(SDCard &sd, Position &position, Record *records, size_t max, SegmentHeader *header = nullptr);
+
+} // namespace datalog
+
+} // namespace blastic
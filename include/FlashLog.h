@@ -0,0 +1,65 @@
+#pragma once
+
+#include "blastic.h"
+#include "SDCard.h"
+
+namespace blastic {
+
+/*
+  Fallback log of the measurements in the DataFlash blocks after the config, used when the SD card is missing or
+  failing. The blocks are a ring: records are programmed in order of sequence number, and when the last block is full
+  the oldest one is erased, so that every block gets the same number of erase cycles. With the config in the first
+  blocks, the ring holds a few hundred measurements.
+
+  Records are moved to the measurement log on the SD card (migrate) as soon as the card works again. The progress of
+  the migration is itself a record (a MIGRATED record, with the last migrated sequence in the epoch field), repeated at
+  the start of each block, so that a power cut at any point can at most migrate some records twice.
+*/
+
+namespace flashlog {
+
+struct Record {
+  enum Flags : uint8_t { TIME_UNSET = 1, MIGRATED = 2 };
+
+  // 0xffffffff for an empty slot
+  uint32_t sequence;
+  int32_t epoch;
+  float weight;
+  plastic type;
+  uint8_t flags;
+  uint16_t crc;
+
+  uint16_t checksum() const { return util::crc32(this, offsetof(Record, crc)); }
+  bool valid() const { return crc == checksum(); }
+};
+
+static_assert(sizeof(Record) == 16);
+
+struct Status {
+  uint32_t blocks, capacity, records, pending, lost;
+};
+
+bool append(int32_t epoch, float weight, plastic type);
+
+// records not migrated yet
+uint32_t pending();
+
+// move the pending records to the measurement log and stats, returns the number of records moved, or -1 on errors
+int migrate(SDCard &sd);
+// migrate() if any record is pending, and report the outcome
+void migratePending(SDCard &sd);
+
+Status status();
+
+/*
+  Read up to max valid records from position, which counts the slots from the oldest one and is advanced past the
+  slots read. Migrated records are included. Returns -1 past the last slot.
+*/
+int read(uint32_t &position, Record *records, size_t max);
+
+// erase all the blocks of the ring
+bool clear();
+
+} // namespace flashlog
+
+} // namespace blastic
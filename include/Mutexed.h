@@ -31,12 +31,19 @@ template <auto &obj> class Mutexed {
   inline static StaticSemaphore_t buffer;
   inline static SemaphoreHandle_t mutex = xSemaphoreCreateRecursiveMutexStatic(&buffer);
   template <typename T> friend class MutexedGenerator;
+  const bool owned;
 
 public:
-  Mutexed() { configASSERT(xSemaphoreTakeRecursive(Mutexed::mutex, portMAX_DELAY)); }
+  Mutexed() : owned(xSemaphoreTakeRecursive(Mutexed::mutex, portMAX_DELAY)) { configASSERT(owned); }
+  // wait at most timeout for the mutex, check the outcome with owns()
+  explicit Mutexed(TickType_t timeout) : owned(xSemaphoreTakeRecursive(Mutexed::mutex, timeout)) {}
   Mutexed(const Mutexed &) = delete;
   Mutexed &operator=(const Mutexed &) = delete;
-  ~Mutexed() { configASSERT(xSemaphoreGiveRecursive(Mutexed::mutex)); }
+  ~Mutexed() {
+    if (owned) configASSERT(xSemaphoreGiveRecursive(Mutexed::mutex));
+  }
+
+  bool owns() const { return owned; }
 
   auto operator->() const { return &obj; }
   auto &operator*() const { return obj; }
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace util {
+
+/*
+  A perfect hash index over a constexpr array whose entries carry a 32 bit key (a murmur3_32 hash of a name), built at
+  compile time, to find an entry in O(1) instead of scanning the array. keyOf gives the key of an entry: a pointer to
+  a data member or to a constexpr member function, or a constexpr callable. Entries with key 0 (such as the array
+  terminators) are not indexed.
+
+  The construction is hash and displace (CHD): keys are grouped in buckets of about 3, and each bucket gets the seed
+  that maps all its keys to free slots, trying the largest buckets first. The slots are a power of two at most 80% full.
+  In flash, the index costs one byte per bucket and one or two per slot, with the entries left where they are. A lookup
+  is a multiplication, a hash and one key comparison.
+
+    static constexpr const PerfectHash index(entries, &Entry::hash);
+    static_assert(index.unique(), "entries with the same key");
+    auto entry = index.find(hash);  // nullptr if not found
+*/
+
+template <typename T, size_t size, typename KeyOf> class PerfectHash {
+public:
+  static constexpr size_t bucketCount = size / 3 + 1;
+  static constexpr size_t slotCount = [] {
+    size_t slots = 1;
+    while (slots * 4 < size * 5) slots *= 2;
+    return slots;
+  }();
+  using Index = std::conditional_t<(size < UINT8_MAX), uint8_t, uint16_t>;
+  static constexpr Index empty = Index(-1);
+  static_assert(size < empty, "too many entries");
+
+  constexpr PerfectHash(const T (&entries)[size], KeyOf keyOf) : entries(entries), keyOf(keyOf) {
+    for (auto &slot : slots) slot = empty;
+    // the entries sorted by bucket, bucketStart[b] is the position of the first entry of bucket b
+    size_t bucketStart[bucketCount + 1]{}, order[size]{}, filled[bucketCount]{};
+    for (size_t i = 0; i < size; i++)
+      if (key(i)) bucketStart[bucket(key(i)) + 1]++;
+    size_t largest = 0;
+    for (size_t b = 0; b < bucketCount; b++) {
+      largest = bucketStart[b + 1] > largest ? bucketStart[b + 1] : largest;
+      bucketStart[b + 1] += bucketStart[b];
+    }
+    for (size_t i = 0; i < size; i++)
+      if (key(i)) order[bucketStart[bucket(key(i))] + filled[bucket(key(i))]++] = i;
+    // equal keys fall in the same bucket, so only the keys within each bucket need to be compared
+    for (size_t b = 0; b < bucketCount; b++)
+      for (size_t i = bucketStart[b]; i < bucketStart[b + 1]; i++)
+        for (size_t j = i + 1; j < bucketStart[b + 1]; j++)
+          if (key(order[i]) == key(order[j])) return;
+    uniqueKeys = true;
+    for (auto bucketSize = largest; bucketSize; bucketSize--)
+      for (size_t b = 0; b < bucketCount; b++)
+        if (bucketStart[b + 1] - bucketStart[b] == bucketSize && !place(order + bucketStart[b], bucketSize, b)) return;
+    complete = true;
+  }
+
+  // false if two entries have the same key
+  constexpr bool unique() const { return uniqueKeys; }
+  // false if no seed places some bucket, the index is then unusable
+  constexpr bool valid() const { return complete; }
+
+  constexpr const T *find(uint32_t key) const {
+    if (!key) return nullptr;
+    auto index = slots[slot(key, seeds[bucket(key)])];
+    return index != empty && this->key(index) == key ? &entries[index] : nullptr;
+  }
+
+private:
+  const T (&entries)[size];
+  const KeyOf keyOf;
+  uint8_t seeds[bucketCount]{};
+  Index slots[slotCount]{};
+  bool uniqueKeys = false, complete = false;
+
+  constexpr uint32_t key(size_t i) const {
+    if constexpr (std::is_member_object_pointer_v<KeyOf>) return entries[i].*keyOf;
+    else if constexpr (std::is_member_function_pointer_v<KeyOf>) return (entries[i].*keyOf)();
+    else return keyOf(entries[i]);
+  }
+
+  // the high bits of key * bucketCount, cheaper than a division
+  static constexpr size_t bucket(uint32_t key) { return uint64_t(key) * bucketCount >> 32; }
+
+  static constexpr size_t slot(uint32_t key, uint8_t seed) {
+    // the murmur3 finalizer
+    uint32_t h = key ^ seed * 0x9e3779b9u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h & (slotCount - 1);
+  }
+
+  constexpr bool place(const size_t *members, size_t count, size_t b) {
+    for (unsigned seed = 0; seed <= UINT8_MAX; seed++) {
+      bool fits = true;
+      for (size_t i = 0; fits && i < count; i++) {
+        auto s = slot(key(members[i]), seed);
+        fits = slots[s] == empty;
+        for (size_t j = 0; fits && j < i; j++) fits = slot(key(members[j]), seed) != s;
+      }
+      if (!fits) continue;
+      seeds[b] = seed;
+      for (size_t i = 0; i < count; i++) slots[slot(key(members[i]), seed)] = Index(members[i]);
+      return true;
+    }
+    return false;
+  }
+};
+
+} // namespace util
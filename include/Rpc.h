@@ -0,0 +1,55 @@
+#pragma once
+
+#include "SerialCliTask.h"
+
+namespace cli {
+
+/*
+  Binary RPC on the serial port of the CLI, for host tools (scripts/rpc). A zero byte in the input ends the current
+  text line and starts a frame, up to the next zero byte; text commands and frames can be mixed freely.
+
+  A frame is a Header, a body and a CRC-32 of both, COBS encoded, with a zero byte on both sides, in both directions.
+  Integers are little endian. Each request gets one or more responses with the same id and type: MORE responses are
+  followed by others, the last one has another status. Malformed frames get no response, just a line of text.
+
+    CALL    body: a command line, up to maxRequestBody bytes, without the 255 character limit of text lines
+            responses MORE with the text output of the command, a line or up to 256 bytes each, then OK (NOT_FOUND
+            if the command does not exist). The serial port is not locked while the command runs: the log lines of
+            other tasks still come as text, between the frames. Commands that read further lines (config::apply,
+            eeprom::import) take them from the text input.
+    GET     body: murmur3_32 of a config field name ("config.scale.mode")
+            response OK: the FieldType of the field (uint8_t), then its value as in memory (strings are the whole
+            buffer, zero terminated)
+    SET     body: the name hash, then the value in the same format as the GET response without the type; the value is
+            validated as the text `set` does, and not saved until eeprom::save
+            response OK with the value set, in the format of the GET response
+    FIELDS  empty body
+            responses MORE for each config field: name hash (uint32_t), FieldType (uint8_t), size (uint16_t), name,
+            then OK with an empty body
+
+  GET and SET reach only the config fields of the schema. The runtime variables that are not in the config (debug,
+  wifi::debug, scale::debug::fake, netstats::logToSD) and the config.scale.calibration.* aliases of the calibration of
+  the current mode are reachable with a CALL of the text get and set commands.
+*/
+
+namespace rpc {
+
+struct Header {
+  // chosen by the host, echoed in the responses
+  uint16_t id;
+  uint8_t type, status;
+} __attribute__((packed));
+
+enum Type : uint8_t { CALL = 1, GET, SET, FIELDS };
+enum Status : uint8_t { OK, MORE, BAD_REQUEST, UNKNOWN_TYPE, NOT_FOUND, INVALID };
+
+constexpr const size_t maxRequestBody = 1024;
+
+// feed a byte of a frame, without the delimiters
+void receive(uint8_t c);
+// decode and run the frame received, at its closing delimiter
+void handle(CliLookup lookup, util::MutexedGenerator<Print> outputMutexGen);
+
+} // namespace rpc
+
+} // namespace cli
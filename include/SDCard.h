@@ -9,19 +9,73 @@
 
 namespace blastic {
 
+/*
+  Lock on the SD card. The volume stays mounted across SDCard instances: the first instance mounts it, and later
+  instances only check that the same card is still inserted (a CID register read, much cheaper than a mount). If the
+  card was removed or swapped, or if a file operation called failed(), the volume is mounted again.
+*/
+
 class SDCard : public util::Mutexed<::SD> {
   const bool initialized;
 
+  static bool mount(uint8_t CSPin);
+
 public:
-  struct Config {
+  template <uint32_t version> struct Config {
+
+    template <uint32_t minVersion, typename enabledType>
+    using fromVersion = util::fromVersion<version, minVersion, enabledType>;
+
     uint8_t CSPin;
+    // AppendFile sync policy: sync after syncRecords records (1 syncs every record), or syncSeconds after the first
+    // unsynced record (0 disables the time limit), whichever comes first
+    fromVersion<8, uint8_t> syncRecords;
+    fromVersion<8, uint16_t> syncSeconds;
   };
 
-  SDCard(uint8_t CSPin) : util::Mutexed<::SD>(), initialized((*this)->begin(CSPin)) {}
-  ~SDCard() {
-    if (initialized) (*this)->end();
-  }
+  SDCard(uint8_t CSPin) : util::Mutexed<::SD>(), initialized(mount(CSPin)) {}
   operator bool() const { return initialized; }
+
+  // call after a failed file operation, so that the volume is mounted again on the next use
+  void failed();
+
+  // incremented on every mount, open files of older generations are invalid
+  static uint32_t generation();
+};
+
+/*
+  A file kept open for appends across SDCard instances. Each record is written with a single write() call, and the
+  file is synced according to the sync policy in config.sdcard. The time based sync is signaled by a timer to a task
+  that runs it with the card locked, so that the timer task never waits for the card nor writes to it. The file is
+  reopened after a remount, and the header function is called to write the header when the file is empty.
+*/
+
+class AppendFile {
+  util::StringBuffer<32> path;
+  void (*const header)(Print &);
+  File file;
+  uint32_t openGeneration = 0;
+  uint8_t unsynced = 0;
+  StaticTimer_t syncTimerBuff;
+  TimerHandle_t syncTimer;
+
+  void close(SDCard &sd);
+  static void syncTimerCallback(TimerHandle_t timer);
+
+public:
+  AppendFile(const char *path, void (*header)(Print &) = nullptr);
+  AppendFile(const AppendFile &) = delete;
+  AppendFile &operator=(const AppendFile &) = delete;
+
+  // the open file, which can also be read, or nullptr on errors
+  File *open(SDCard &sd);
+  bool append(SDCard &sd, const void *record, size_t length);
+  // the methods below must be called with the card locked
+  bool sync(SDCard &sd);
+  // sync and close the file, the next append opens path
+  void reopen(SDCard &sd, const char *path);
+  // truncate the file opened with open()
+  bool truncate(uint32_t size);
 };
 
 } // namespace blastic
@@ -31,3 +85,10 @@ public:
 */
 
 ClassPrivateMemberAccessor(SDClass, Sd2Card, card);
+
+/*
+  The File API cannot truncate, nor drop a handle without syncing it, which must not happen once the card it was opened
+  on is gone.
+*/
+
+ClassPrivateMemberAccessor(File, SdFile *, _file);
@@ -12,22 +12,32 @@ namespace cli {
 class WordSplit;
 class CliCallback;
 
+// find the command with the given hash, nullptr if none
+using CliLookup = const CliCallback *(*)(uint32_t commandHash);
+
 namespace details {
 
 struct SerialCliTaskState {
-  const CliCallback *const callbacks;
+  const CliLookup lookup;
 };
 void consumeAutostartFiles(const SerialCliTaskState &_this, util::MutexedGenerator<Print> outputMutexGen);
 void loop(const SerialCliTaskState &_this, Stream &input, util::MutexedGenerator<Print> outputMutexGen, bool loop);
+// wake the calling task from the receive interrupt of uart at the end of each line, instead of polling
+void notifyOnInput(UART &uart);
 
 } // namespace details
 
+namespace rpc {
+void handle(CliLookup lookup, util::MutexedGenerator<Print> outputMutexGen);
+}
+
 /*
   A CliCallback struct contains the MurMur3 hash of the command string, and
   the corresponding function pointer to call.
 
   The constructors are all constexpr, so that the compiler can avoid emitting
-  the string for the command.
+  the string for the command. Index a CliCallback array with util::PerfectHash
+  and &CliCallback::hash to make the CliLookup.
 */
 
 class CliCallback {
@@ -40,14 +50,17 @@ public:
   constexpr CliCallback(const char *str, CliFunctionPointer function)
       : cliCommandHash(util::murmur3_32(str)), function(function) {}
 
+  constexpr uint32_t hash() const { return cliCommandHash; }
+
 private:
   friend void details::loop(const details::SerialCliTaskState &_this, Stream &input,
                             util::MutexedGenerator<Print> outputMutexGen, bool loop);
+  friend void rpc::handle(CliLookup lookup, util::MutexedGenerator<Print> outputMutexGen);
 
   const uint32_t cliCommandHash;
   const CliFunctionPointer function;
 
-  template <auto &, size_t> friend class SerialCliTask;
+  template <auto &, size_t, auto &> friend class SerialCliTask;
 };
 
 /*
@@ -92,6 +105,14 @@ public:
   }
 };
 
+/*
+  A command can take the input lines that follow it, for multi-line input: after captureLines(capture), each line is
+  passed to capture instead of being run as a command, until capture returns false (by convention on a line `end`).
+  When an autostart file ends during a capture, capture is called with nullptr to abort it.
+*/
+using LineCapture = bool (*)(WordSplit *line);
+void captureLines(LineCapture capture);
+
 /*
   Simple implementation of a command line interface over Serial.
 
@@ -115,7 +136,8 @@ public:
   This CLI task runs with the highest priority available, in order to be able to work
   even when other tasks hang for any reason.
 
-  This class is a template in order to use util::Mutexed<serial>. Note however that
+  This class is a template in order to use util::Mutexed<output>, where output is the Print
+  that the text goes to, serial unless it is wrapped by another object. Note however that
   mutexed access is used only when printing error messages from the callback parsing function.
   Access in read to the serial does *not* use locking, as we assume that we are the only
   client reading serial.
@@ -124,21 +146,25 @@ public:
   reads, which would slow down the device as this task runs with the maximum priority.
   This is done to enable the execution of debug command via serial in a timely manner,
   regardless of the other tasks' state.
+
+  With a UART serial, the receive interrupt notifies the task when a line ends, so that
+  the task stays blocked while idle and runs a command as soon as it arrives. Other
+  serials are polled.
 */
 
-template <auto &serial, size_t StackSize = configMINIMAL_STACK_SIZE * sizeof(StackType_t)> class SerialCliTask {
+template <auto &serial, size_t StackSize = configMINIMAL_STACK_SIZE * sizeof(StackType_t), auto &output = serial>
+class SerialCliTask {
 
 public:
-  using MSerial = util::Mutexed<serial>;
+  using MSerial = util::Mutexed<output>;
 
   // Note: the serial must be initialized alreay
-  SerialCliTask(const CliCallback *callbacks, const char *name = "SerialCliTask",
-                UBaseType_t priority = configMAX_PRIORITIES - 1)
-      : _this({callbacks}), task(SerialCliTask::loop, this, name, priority) {
+  SerialCliTask(CliLookup lookup, const char *name = "SerialCliTask", UBaseType_t priority = configMAX_PRIORITIES - 1)
+      : _this({lookup}), task(SerialCliTask::loop, this, name, priority) {
     /*
       Read operations busy poll using millis(). This task
       runs with the maximum priority, so we must not starve the other
-      tasks in blocking read operations. Polling with task delays is
+      tasks in blocking read operations. Waiting for input is
       handled in loop().
     */
     serial.setTimeout(0);
@@ -149,8 +175,9 @@ private:
   util::StaticTask<StackSize> task;
   static void loop(void *me) [[noreturn]] {
     auto &_this = *reinterpret_cast<SerialCliTask *>(me);
-    details::consumeAutostartFiles(_this._this, util::MutexedGenerator<Print>::get<serial>());
-    details::loop(_this._this, serial, util::MutexedGenerator<Print>::get<serial>(), true);
+    if constexpr (std::is_base_of_v<UART, std::remove_reference_t<decltype(serial)>>) details::notifyOnInput(serial);
+    details::consumeAutostartFiles(_this._this, util::MutexedGenerator<Print>::get<output>());
+    details::loop(_this._this, serial, util::MutexedGenerator<Print>::get<output>(), true);
   }
 };
 
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Arduino_FreeRTOS.h>
+#include "StaticTask.h"
+#include "Submitter.h"
+#include "DataLog.h"
+
+namespace blastic {
+
+namespace sinks {
+
+/*
+  A submission sink uploads measurements to some server. The Submitter pushes measurements in a single queue, which is
+  drained by the Dispatcher task: each batch of queued measurements is passed to all the configured sinks in turn (there
+  is a single modem), while holding a single WiFi connection. The Submitter does not wait for the uploads, so the
+  measurements taken meanwhile pile up in the queue and make the next batch.
+
+  Sinks are configured with the `set` accessors under config.submit.
+*/
+
+struct Measurement {
+  int32_t epoch;
+  float weight;
+  plastic type;
+};
+
+// the names that a batch of measurements was collected under: the current config.submit ones for live measurements
+struct Collector {
+  const char *collectionPoint, *collectorName;
+
+  static Collector current() { return {config.submit.collectionPoint, config.submit.collectorName}; }
+  bool isCurrent() const {
+    auto &submit = config.submit;
+    return !strcmp(collectionPoint, submit.collectionPoint) && !strcmp(collectorName, submit.collectorName);
+  }
+};
+
+enum class State : uint8_t {
+  // the sink is missing some required configuration
+  UNCONFIGURED,
+  // network or protocol error
+  ERROR,
+  // the server answered with an error code
+  REJECTED,
+  OK
+};
+
+struct Result {
+  State state;
+  // HTTP status code, or protocol specific error code
+  int code;
+};
+
+constexpr const size_t maxBatch = 16;
+// replay chunks are larger, as each costs a WiFi connection and a TLS handshake per sink
+constexpr const size_t maxReplayBatch = 64;
+
+class Sink {
+public:
+  // short name used in notices, empty for the Precious Plastic form
+  const char *const name;
+
+  Sink(const char *name) : name(name) {}
+  virtual bool configured() const = 0;
+  // the batch is never empty, and the WiFi connection is up
+  virtual Result submit(const Measurement *batch, size_t n, const Collector &collector) = 0;
+
+private:
+  friend class Dispatcher;
+  // live measurements that the sink did not accept, retried by the Dispatcher
+  Measurement retry[maxBatch];
+  size_t retrying = 0;
+  // datalog::collectorHash() of the names of the measurements in retry
+  uint32_t retryCollector;
+
+  void keep(const Measurement *batch, size_t n, uint32_t collector);
+  void drop(size_t n, const char *reason);
+};
+
+/*
+  Reports of the outcome of each batch of live measurements, received by the Submitter task whenever it is free to show
+  them. Errors that prevent running any sink have sink == nullptr, the last report of a batch has last == true, count is
+  the number of measurements in the batch. Retries are not reported.
+*/
+
+struct Report {
+  enum Link : uint8_t { NO_ERROR, FIRMWARE, WIFI };
+  const Sink *sink;
+  Link link;
+  bool last;
+  Result result;
+  uint8_t count = 0;
+};
+
+/*
+  Bulk upload of the measurements, in chunks of maxReplayBatch records: first the rows of data.csv, the log of the
+  firmware versions before the binary measurement log, if the card still has one, then the binary log. After each chunk
+  is accepted by all the configured sinks, the position of the next record and the epoch of the last record are saved
+  in a cursor file, so that an interrupted replay resumes where it stopped. If the log is shorter than the cursor (the
+  SD card was replaced), the replay restarts from its beginning but skips records older than the last replayed epoch.
+
+  Records are submitted under the names they were collected under, the columns of data.csv or the header of their log
+  segment, so a chunk never spans a change of names.
+*/
+
+class Replay {
+public:
+  struct Cursor {
+    // the byte offset in data.csv while position.segment is 0, then the position in the log
+    uint32_t csvOffset;
+    datalog::Position position;
+    int32_t lastEpoch, fromEpoch;
+  };
+
+  // start from the beginning of the log, skipping records older than fromEpoch
+  void begin(int32_t fromEpoch);
+  // continue from the cursor file
+  void resume();
+  // read the next chunk, returns 0 at the end of the log or on errors
+  size_t read(Measurement *batch, size_t max);
+  // the names of the last chunk read
+  Collector collector() const { return {collectionPoint, collectorName}; }
+  // the last chunk has been submitted, persist the cursor
+  void commit();
+  void end(const char *reason);
+  explicit operator bool() const { return active; }
+
+private:
+  bool active = false;
+  Cursor cursor, next;
+  decltype(Submitter::Config<0>::collectionPoint) collectionPoint, collectorName;
+  uint32_t csvSize, segments, rows, skipped, startMillis;
+  size_t pending;
+  bool saveCursor();
+  bool inCsv(const Cursor &cursor) const { return !cursor.position.segment && cursor.csvOffset < csvSize; }
+  size_t readCsv(SDCard &sd, Measurement *batch, size_t max);
+  size_t readLog(SDCard &sd, Measurement *batch, size_t max);
+  void printPosition(Print &p) const;
+};
+
+class Dispatcher {
+public:
+  Dispatcher(const char *name, UBaseType_t priority);
+
+  // queue a measurement, request reports with report = true
+  bool push(const Measurement &measurement, bool report, TickType_t timeout = 0);
+  bool receiveReport(Report &report, TickType_t timeout);
+  bool reportsPending() const { return uxQueueMessagesWaiting(reports); }
+  // control the replay of the measurement log, which runs only while no measurements are queued
+  bool replay(int32_t fromEpoch, TickType_t timeout = 0);
+  bool resumeReplay(TickType_t timeout = 0);
+  bool stopReplay(TickType_t timeout = 0);
+
+private:
+  struct Item {
+    enum Command : uint8_t { SUBMIT, REPLAY, RESUME_REPLAY, STOP_REPLAY };
+    Command command;
+    bool report;
+    // the epoch is the starting epoch for REPLAY
+    Measurement measurement;
+  };
+  static constexpr const size_t queueLength = 32, reportsLength = 16;
+  StaticQueue_t queueBuff, reportsBuff;
+  uint8_t queueObjectsBuff[queueLength * sizeof(Item)], reportsObjectsBuff[reportsLength * sizeof(Report)];
+  const QueueHandle_t queue, reports;
+  util::StaticTask<4 * 1024> task;
+  Replay replaying;
+  Measurement replayBatch[maxReplayBatch];
+  // the failed live measurements are retried retryDelay milliseconds after retryMillis, 0 if there are none
+  uint32_t retryMillis, retryDelay = 0;
+
+  void report(const Report &report);
+  // live batches that fail are kept for retrying
+  bool dispatch(const Measurement *batch, size_t n, const Collector &collector, bool live, bool reportBatch);
+  TickType_t retryWait() const;
+  void retryFailed();
+  void loop() [[noreturn]];
+  static void loop(void *_this) [[noreturn]] { reinterpret_cast<Dispatcher *>(_this)->loop(); }
+};
+
+Dispatcher &dispatcher();
+
+/*
+  Sinks cache some data derived from config.submit (such as URL-encoded strings). Call this after changing it.
+*/
+void configChanged();
+
+} // namespace sinks
+
+} // namespace blastic
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "blastic.h"
+#include "SDCard.h"
+
+namespace blastic {
+
+/*
+  Running aggregates of the logged measurements, kept in the fixed size file STATS.BIN on the SD card: totals per
+  plastic type, per type for each of the last days (UTC), and per type for the most recent collectors. Each measurement
+  updates three aggregates in place, and each query reads a single fixed position, so neither depends on the size of
+  the log. Measurements with the time unset only count in the totals and collectors.
+*/
+
+namespace stats {
+
+struct Aggregate {
+  uint32_t count;
+  float sum, min, max;
+
+  void add(float weight);
+  Aggregate &operator+=(const Aggregate &o);
+};
+
+using TypeAggregates = Aggregate[std::size(plastics)];
+
+constexpr const size_t dayWindow = 32, collectorSlots = 8;
+
+struct Day {
+  // days since the epoch, 0 if the slot is unused
+  int32_t day;
+  TypeAggregates types;
+};
+
+struct Collector {
+  // datalog::collectorHash(), 0 if the slot is unused
+  uint32_t collector;
+  int32_t lastEpoch;
+  decltype(Submitter::Config<0>::collectionPoint) collectionPoint, collectorName;
+  TypeAggregates types;
+};
+
+bool add(SDCard &sd, int32_t epoch, float weight, plastic type, const char *collectionPoint,
+         const char *collectorName);
+
+bool totals(SDCard &sd, TypeAggregates &types);
+// false if the day is out of the window of the last days
+bool day(SDCard &sd, int32_t epoch, TypeAggregates &types);
+bool collector(SDCard &sd, size_t slot, Collector &collector);
+
+// clear all the aggregates, to rebuild them from the log
+bool reset(SDCard &sd);
+
+} // namespace stats
+
+} // namespace blastic
@@ -59,12 +59,28 @@ public:
     Param type, collectionPoint, collectorName, weight;
   };
 
+  // batched JSON POST, the token is sent as a bearer token if not empty
+  struct JsonParameters {
+    util::StringBuffer<128> urn;
+    util::StringBuffer<64> token;
+  };
+
+  // MQTT over TLS, with a persistent session (client id defaults to the WiFi MAC address)
+  struct MqttParameters {
+    util::StringBuffer<64> host, topic;
+    uint16_t port;
+    util::StringBuffer<32> clientId, username;
+    util::StringBuffer<64> password;
+  };
+
   template <uint32_t version> struct Config {
     float threshold;
     util::fromVersion<version, 4, bool> skipPPForm;
     util::fromVersion<version, 5, bool> spacesWorkaroundPPForm;
     util::StringBuffer<128> collectionPoint, collectorName;
     FormParameters userForm;
+    util::fromVersion<version, 6, JsonParameters> json;
+    util::fromVersion<version, 6, MqttParameters> mqtt;
   };
 
   Submitter(const char *name, UBaseType_t priority);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Scale.h"
+
+namespace blastic {
+
+/*
+  State that survives a reset, so that a warm boot (watchdog, reset button, brown-out) does not start from scratch: the
+  tare of the scale, the time, and the Wi-Fi network that connected last. It lives in the VBATT backup registers of the
+  RA4M1, which keep their content through every reset but are lost with the power, unless a battery is connected to
+  VRTC. The record carries a CRC, anything else reads as a cold boot.
+
+  The warm values are a starting point: the submitter takes a fresh tare the first time the scale sits empty, the time
+  is restored without counting as a sync, so NTP still runs in the background, and a failed attempt at the last network
+  falls back to the usual scan.
+*/
+
+namespace warm {
+
+struct State {
+  // consecutive warm boots, 0 on a cold boot
+  uint32_t boots;
+  // unix time at the last save (every few seconds while the time is set), 0 if unknown
+  int32_t epoch;
+  // tareValid is false until a tare is saved
+  int32_t tareRead;
+  scale::HX711Mode tareMode;
+  bool tareValid;
+  // murmur3_32 of the ssid that connected last, 0 if none
+  uint32_t networkHash;
+};
+
+// validate the record, call once at boot before the other functions; false on a cold boot
+bool begin();
+State get();
+
+// the warm tare for mode, if any
+bool tare(scale::HX711Mode mode, int32_t &tareRead);
+void saveTare(scale::HX711Mode mode, int32_t tareRead);
+void saveNetwork(uint32_t ssidHash);
+
+} // namespace warm
+
+} // namespace blastic
@@ -26,14 +26,39 @@ public:
   static const bool ipConnectBroken;
   static bool firmwareCompatible();
 
-  struct Config {
+  struct Credentials {
+    util::StringBuffer<32> ssid;
+    util::StringBuffer<64> password;
+  };
+
+  static constexpr const size_t maxAlternates = 3;
+
+  template <uint32_t version> struct Config {
     // leave the password empty to connect to an open network
     util::StringBuffer<32> ssid;
     util::StringBuffer<64> password;
     uint8_t dhcpTimeout, idleTimeout;
+    util::fromVersion<version, 7, Credentials[maxAlternates]> alternates;
+  };
+
+  /*
+    With alternate networks configured, a cached scan ranks the networks by their last known RSSI, with a bonus for
+    the one that connected last. Networks missing from the scan are not tried, so a far away AP does not cost a full
+    begin() timeout. The first connection after a warm boot tries the network that connected before the reset without
+    scanning.
+  */
+  static constexpr const size_t maxNetworks = 1 + maxAlternates;
+
+  struct NetworkStats {
+    uint32_t ssidHash;
+    // from the last scan or connection, 0 if unknown
+    int32_t rssi;
+    uint32_t attempts, successes, totalConnectMillis, maxConnectMillis, lastSuccessMillis;
   };
+  static NetworkStats networkStats[maxNetworks];
+  static void invalidateScan();
 
-  Layer3(const Config &config);
+  template <uint32_t version> Layer3(const Config<version> &config) : Layer3(networks(config), config.dhcpTimeout) {}
   // was the connection successful?
   operator bool() const;
   ~Layer3();
@@ -41,6 +66,25 @@ public:
   static util::Looper<1024> &background();
 
 private:
+  struct Network {
+    const char *ssid, *password;
+  };
+  struct Networks {
+    Network list[maxNetworks];
+    size_t count;
+  };
+
+  template <uint32_t version> static Networks networks(const Config<version> &config) {
+    Networks networks{{{config.ssid, config.password}}, 1};
+    if constexpr (version >= 7)
+      for (auto &alternate : config.alternates) networks.list[networks.count++] = {alternate.ssid, alternate.password};
+    return networks;
+  }
+
+  Layer3(const Networks &networks, uint8_t dhcpTimeout);
+  bool connect(const Network &network, NetworkStats &stats, uint8_t dhcpTimeout);
+  void scan(const Networks &networks);
+
   Layer3();
   friend void ::ntp::startSync(bool force);
   const bool backgroundJob;
@@ -77,14 +121,30 @@ public:
     some time after receiving no data (read() == 0).
 
     These read() function overrides make sure that a connected() call is made right before
-    (suppressing other FreeRTOS tasks) the actual read, to *minimize* the chances of
-    crashing. I really hope that I'll be able to get the Arduino developers to push a
-    firmware version 0.5.0, fixing this behavior.
-
+    the actual read, to *minimize* the chances of crashing. I really hope that I'll be able
+    to get the Arduino developers to push a firmware version 0.5.0, fixing this behavior.
+
+    The pair of modem commands is issued while holding the WiFi mutex, so no other task can
+    interleave its own modem traffic. This only serializes the access to the modem, it is not
+    atomic as suspending the scheduler (done previously) was: this task can be preempted between
+    connected() and read(), widening the window in which the esp32s3 can process a close. In
+    exchange, the whole system is no longer frozen for two UART round trips per read.
+    The time spent in the pair is tracked in readStats, as a measure of the old blackout.
   */
   virtual int read();
   virtual int read(uint8_t *buf, size_t size);
   ~SSLClient() { stop(); }
+
+  struct ReadStats {
+    uint32_t count;
+    // a uint32_t would wrap after 71 minutes spent in reads
+    uint64_t totalMicros;
+    uint32_t maxMicros;
+  };
+  static ReadStats readStats;
+
+private:
+  template <typename ReadFunction> int guardedRead(ReadFunction &&read);
 };
 
 } // namespace wifi
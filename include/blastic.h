@@ -11,6 +11,7 @@
 #include <Arduino.h>
 #include <Arduino_FreeRTOS.h>
 #include "Mutexed.h"
+#include "Boot.h"
 
 // classes / task functions for devices
 #include "Scale.h"
@@ -45,21 +46,36 @@ template <uint32_t version> struct Config {
   using fromVersion = util::fromVersion<version, minVersion, enabledType>;
 
   scale::Config scale;
-  wifi::Layer3::Config wifi;
+  wifi::Layer3::Config<version> wifi;
   blastic::Submitter::Config<version> submit;
   buttons::Config buttons;
-  fromVersion<1, SDCard::Config> sdcard;
+  fromVersion<1, SDCard::Config<version>> sdcard;
   ntp::Config<version> ntp;
 
   std::tuple<IOret, uint32_t> load();
   IOret save() const;
+  // load a config of any version from length bytes at data (which can be this object), nothing changes on errors
+  IOret convert(const void *data, size_t length);
   void sanitize();
   void defaults();
 };
 
-constexpr const uint32_t currentVersion = 5;
+constexpr const uint32_t currentVersion = 8;
 
-extern const uint32_t maxConfigLength;
+template <uint32_t version = currentVersion> constexpr size_t getMaxConfigLength(size_t max = 0) {
+  constexpr const size_t size = sizeof(Config<version>);
+  size_t newMax = max > size ? max : size;
+  if constexpr (!version) return newMax;
+  else return getMaxConfigLength<version - 1>(newMax);
+}
+
+constexpr const uint32_t maxConfigLength = getMaxConfigLength();
+
+extern const Config<currentVersion> defaultConfig;
+
+// DataFlash bytes reserved to the config, and offset of the current config in them (lock the DataFlash to call)
+uint32_t configAreaSize();
+uint32_t configOffset();
 
 } // namespace eeprom
 
@@ -67,8 +83,13 @@ using Config = eeprom::Config<eeprom::currentVersion>;
 
 extern Config config;
 
-// take these mutexes to access a global device
-using MSerial = util::Mutexed<::Serial>;
+// take these mutexes to access a global device (the serial output goes through the boot console)
+using MSerial = util::Mutexed<boot::console>;
 using MWiFi = util::Mutexed<::WiFi>;
 
+// the DataFlash holds both the config and the flash log, take this mutex to access it
+inline struct DataFlashLock {
+} dataFlashLock;
+using MDataFlash = util::Mutexed<dataFlashLock>;
+
 } // namespace blastic
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <iterator>
+#include <Arduino.h>
+
+namespace netstats {
+
+/*
+  Latency of each phase of a network operation, in milliseconds. Each phase keeps a window of the last samples, which
+  is summarized on demand as min/avg/p95/max.
+
+  DNS resolution happens inside the WiFi module during the TLS connect, so it is measured with an explicit lookup
+  right before the connection, which warms the module DNS cache for the connect itself.
+*/
+
+enum class Phase : uint8_t { association, dhcp, dns, tlsConnect, request, response, ntp, count };
+
+constexpr const char *phaseNames[]{"association", "dhcp", "dns", "tls", "request", "response", "ntp"};
+static_assert(std::size(phaseNames) == size_t(Phase::count));
+
+constexpr const size_t window = 32;
+
+void record(Phase phase, uint32_t millis);
+
+struct Summary {
+  uint32_t count, min, avg, p95, max;
+};
+
+Summary summary(Phase phase);
+
+/*
+  Samples recorded since the last call to beginSubmission(), 0 if the phase did not happen. Used for the per-submission
+  log on SD.
+*/
+void beginSubmission();
+uint32_t lastSubmission(Phase phase);
+
+// append the per-submission samples to netstats.csv on the SD card
+extern bool logToSD;
+
+/*
+  Measure consecutive phases: each lap() records the time since the previous lap (or construction).
+*/
+
+class Stopwatch {
+  uint32_t start = millis();
+
+public:
+  void restart() { start = millis(); }
+  uint32_t lap(Phase phase) {
+    auto now = millis(), elapsed = now - start;
+    record(phase, elapsed);
+    start = now;
+    return elapsed;
+  }
+};
+
+} // namespace netstats
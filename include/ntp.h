@@ -16,5 +16,15 @@ template <size_t version> struct Config {
 
 int unixTime();
 void startSync(bool force = false);
+// set the time if unset, from a previous estimate such as the one saved before a reset; it does not count as a sync
+void restore(int epoch);
+
+/*
+  Low precision time source: the Date header of HTTP responses (RFC 7231 IMF-fixdate). It is used only when the time is
+  unset or older than the NTP refresh period, and it counts as a sync, so that NTP runs only when no HTTP traffic kept
+  the time fresh.
+*/
+bool stale();
+bool syncFromHttpDate(const char *date);
 
 } // namespace ntp
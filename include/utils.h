@@ -12,7 +12,7 @@ template <size_t size> struct StringBuffer : public std::array<char, size> {
 
   using std::array<char, size>::array;
 
-  StringBuffer &operator=(const char *src) { this->strncpy(src); }
+  StringBuffer &operator=(const char *src) { return this->strncpy(src); }
 
   operator char *() { return this->data(); }
 
@@ -27,6 +27,129 @@ template <size_t size> struct StringBuffer : public std::array<char, size> {
   }
 };
 
+/*
+  URL encoding with the same character set as URLEncoder from ArduinoHttpClient, but without String allocations.
+  urlEncodedSize() is the worst case buffer size (including the terminator) to encode a StringBuffer<size>. The output
+  is truncated on a character boundary if dst is too small.
+*/
+
+constexpr size_t urlEncodedSize(size_t size) { return 3 * (size - 1) + 1; }
+
+inline size_t urlEncode(char *dst, size_t dstSize, const char *src) {
+  constexpr const char hexDigits[] = "0123456789ABCDEF";
+  auto dstStart = dst, dstEnd = dst + dstSize - 1;
+  for (; *src; src++) {
+    auto c = *src;
+    if (isAlphaNumeric(c) || c == '-' || c == '.' || c == '_' || c == '~') {
+      if (dst == dstEnd) break;
+      *dst++ = c;
+      continue;
+    }
+    if (dstEnd - dst < 3) break;
+    *dst++ = '%';
+    *dst++ = hexDigits[(c >> 4) & 0xf];
+    *dst++ = hexDigits[c & 0xf];
+  }
+  *dst = '\0';
+  return dst - dstStart;
+}
+
+/*
+  StringBuilder is a StringBuffer that can be appended to, tracking its length. Appends that do not fit are truncated
+  and set the overflow flag.
+*/
+
+template <size_t size> class StringBuilder : public StringBuffer<size> {
+  size_t len = 0;
+  bool overflowed = false;
+
+public:
+  StringBuilder() { clear(); }
+
+  StringBuilder &clear() {
+    (*this)[len = 0] = '\0';
+    overflowed = false;
+    return *this;
+  }
+
+  StringBuilder &operator+=(char c) {
+    if (len == size - 1) overflowed = true;
+    else (*this)[len++] = c, (*this)[len] = '\0';
+    return *this;
+  }
+
+  StringBuilder &operator+=(const char *str) {
+    auto strLen = std::strlen(str), room = size - 1 - len;
+    if (strLen > room) strLen = room, overflowed = true;
+    std::memcpy(this->data() + len, str, strLen);
+    (*this)[len += strLen] = '\0';
+    return *this;
+  }
+
+  size_t length() const { return len; }
+  bool overflow() const { return overflowed; }
+};
+
+/*
+  A Print that discards its output and counts the bytes, to precompute Content-Length headers of streamed bodies.
+*/
+
+class CountingPrint : public Print {
+public:
+  size_t count = 0;
+  size_t write(uint8_t) override { return count++, 1; }
+  size_t write(const uint8_t *, size_t size) override { return count += size, size; }
+};
+
+/*
+  CRC-32 (IEEE 802.3, as in zlib), bitwise to save the table flash. Pass the previous result as crc to continue a
+  checksum over multiple buffers.
+*/
+
+inline uint32_t crc32(const void *data, size_t length, uint32_t crc = 0) {
+  auto bytes = static_cast<const uint8_t *>(data);
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= bytes[i];
+    for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1));
+  }
+  return ~crc;
+}
+
+/*
+  Consistent Overhead Byte Stuffing: the encoded data contains no zero bytes, so that a zero can delimit frames in a
+  byte stream. cobsEncodedSize() is the worst case size of the encoding of size bytes, without the delimiter.
+  cobsDecode() takes a frame without the delimiters, dst can be data itself, and returns -1 on invalid encodings.
+*/
+
+constexpr size_t cobsEncodedSize(size_t size) { return size + size / 254 + 1; }
+
+inline size_t cobsEncode(const void *data, size_t length, uint8_t *dst) {
+  auto src = static_cast<const uint8_t *>(data);
+  auto dstStart = dst, code = dst++;
+  *code = 1;
+  for (size_t i = 0; i < length; i++) {
+    if (src[i]) *dst++ = src[i], ++*code;
+    if (!src[i] || *code == 0xff) {
+      code = dst++;
+      *code = 1;
+    }
+  }
+  return dst - dstStart;
+}
+
+inline int cobsDecode(const void *data, size_t length, uint8_t *dst) {
+  auto src = static_cast<const uint8_t *>(data), end = src + length;
+  auto dstStart = dst;
+  while (src < end) {
+    auto code = *src++;
+    if (!code || code - 1 > end - src) return -1;
+    for (auto i = 1; i < code; i++) *dst++ = *src++;
+    if (code != 0xff && src < end) *dst++ = 0;
+  }
+  return dst - dstStart;
+}
+
 /*
   Some Arduino API is especially badly designed as some critical class members are private.
   Here use some magic to access them.
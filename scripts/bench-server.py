@@ -0,0 +1,103 @@
+#!/bin/env python
+
+"""
+TLS server for the wifi::bench command. Each connection accepts line based commands:
+
+  PING        replies PONG
+  DOWN <n>    sends n bytes
+  UP <n>      receives n bytes, then replies OK
+
+The board validates the server certificate, so by default a certificate for the given hostname is generated and
+signed with the mitmproxy CA, which can be added to the WiFi module firmware as described in DEBUGGING.md.
+"""
+
+import argparse
+import os
+import socketserver
+import ssl
+import subprocess
+import tempfile
+import time
+
+CHUNK = 16 * 1024
+
+
+class BenchHandler(socketserver.StreamRequestHandler):
+    def handle(self):
+        peer = self.client_address[0]
+        start = time.monotonic()
+        while True:
+            line = self.rfile.readline()
+            if not line:
+                break
+            command, *args = line.decode(errors="replace").split() or [""]
+            remaining = int(args[0]) if len(args) == 1 and args[0].isdigit() else None
+            if command == "PING" and not args:
+                self.wfile.write(b"PONG\n")
+            elif command == "DOWN" and remaining is not None:
+                chunk = b"x" * CHUNK
+                while remaining:
+                    n = min(remaining, CHUNK)
+                    self.wfile.write(chunk[:n])
+                    remaining -= n
+            elif command == "UP" and remaining is not None:
+                while remaining:
+                    data = self.rfile.read(min(remaining, CHUNK))
+                    if not data:
+                        return
+                    remaining -= len(data)
+                self.wfile.write(b"OK\n")
+            else:
+                self.wfile.write(b"ERROR\n")
+            self.wfile.flush()
+        print(f"{peer}: connection closed after {time.monotonic() - start:.3f}s")
+
+
+class TLSServer(socketserver.ThreadingMixIn, socketserver.TCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+    def __init__(self, address, context):
+        super().__init__(address, BenchHandler)
+        self.context = context
+
+    def get_request(self):
+        sock, address = super().get_request()
+        return self.context.wrap_socket(sock, server_side=True), address
+
+
+def make_certificate(hostname, ca, directory):
+    key, csr, cert = (os.path.join(directory, name) for name in ("key.pem", "csr.pem", "cert.pem"))
+    ext = os.path.join(directory, "ext.cnf")
+    with open(ext, "w") as f:
+        f.write(f"subjectAltName=DNS:{hostname}\n")
+    subprocess.check_call(["openssl", "req", "-new", "-newkey", "rsa:2048", "-nodes", "-keyout", key, "-out", csr,
+                           "-subj", f"/CN={hostname}"], stderr=subprocess.DEVNULL)
+    subprocess.check_call(["openssl", "x509", "-req", "-in", csr, "-CA", ca, "-CAkey", ca, "-CAcreateserial",
+                           "-CAserial", os.path.join(directory, "ca.srl"), "-days", "30", "-extfile", ext, "-out",
+                           cert], stderr=subprocess.DEVNULL)
+    return cert, key
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("hostname", help="hostname the board connects to, e.g. 192.168.1.10.nip.io")
+    parser.add_argument("--port", type=int, default=443)
+    parser.add_argument("--cert", help="server certificate, generated if missing")
+    parser.add_argument("--key", help="server certificate key")
+    parser.add_argument("--ca", default=os.path.expanduser("~/.mitmproxy/mitmproxy-ca.pem"),
+                        help="CA certificate and key used to sign the generated certificate")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as directory:
+        cert, key = (args.cert, args.key) if args.cert else make_certificate(args.hostname, args.ca, directory)
+        context = ssl.create_default_context(ssl.Purpose.CLIENT_AUTH)
+        context.load_cert_chain(cert, key)
+        with TLSServer(("", args.port), context) as server:
+            print(f"bench-server: listening on port {args.port}, run on the board:")
+            print(f"  wifi::bench {args.hostname} {args.port}")
+            server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,14 @@
+#!/bin/bash
+
+# Build the host upload benchmark: the real sinks code (src/Sinks.cpp and its dependencies) against the shims in shims/.
+
+set -euo pipefail
+
+cd "$(dirname "$0")"
+root=../..
+mkdir -p $root/.host-bench-build
+g++ -std=gnu++17 -O2 -g -Wall -Wno-unused-function -Wno-attributes -Wno-stringop-truncation -pthread \
+  -Ishims -I$root/include -DBLASTIC_MONITOR_SPEED=115200 $(python3 $root/scripts/git_rev_macro.py | xargs) \
+  -DBLASTIC_BUILD_SYSTEM=\"host\" $root/src/Sinks.cpp $root/src/Replay.cpp $root/src/netstats.cpp \
+  $root/src/SDCard.cpp $root/src/DataLog.cpp shims/host.cpp \
+  upload-bench.cpp -lssl -lcrypto -o $root/.host-bench-build/upload-bench "${@}"
@@ -0,0 +1,107 @@
+#pragma once
+
+/*
+  Minimal Arduino core for the host build: only what the upload path and its headers use. Print follows the
+  ArduinoCore-API semantics, everything is single byte and blocking.
+*/
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <cctype>
+#include <algorithm>
+
+using std::isfinite;
+using std::isinf;
+using std::isnan;
+
+typedef void (*voidFuncPtr)(void);
+typedef uint8_t byte;
+
+#define DEC 10
+#define HEX 16
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+inline bool isAlphaNumeric(int c) { return isalnum(c); }
+char *dtostrf(double value, signed char width, unsigned char precision, char *buffer);
+template <class T, class U> auto min(const T &a, const U &b) { return a < b ? a : b; }
+template <class T, class U> auto max(const T &a, const U &b) { return a > b ? a : b; }
+
+class Print {
+  int writeError = 0;
+
+protected:
+  void setWriteError(int error = 1) { writeError = error; }
+
+public:
+  virtual ~Print() = default;
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) { return str ? write(reinterpret_cast<const uint8_t *>(str), strlen(str)) : 0; }
+  size_t write(const char *buffer, size_t size) { return write(reinterpret_cast<const uint8_t *>(buffer), size); }
+  virtual int availableForWrite() { return 0; }
+  virtual void flush() {}
+  int getWriteError() { return writeError; }
+  void clearWriteError() { setWriteError(0); }
+
+  size_t print(const char *str) { return write(str); }
+  size_t print(char c) { return write(uint8_t(c)); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(long long n, int base = DEC);
+  size_t print(unsigned long long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  template <typename T> size_t println(T &&value) { return print(value) + println(); }
+  template <typename T> size_t println(T &&value, int format) { return print(value, format) + println(); }
+  size_t println() { return write("\r\n"); }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+};
+
+class IPAddress {
+  uint32_t address = 0;
+
+public:
+  IPAddress() = default;
+  IPAddress(uint32_t address) : address(address) {}
+  operator uint32_t() const { return address; }
+};
+
+class Client : public Stream {
+public:
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual int connect(const char *host, uint16_t port) = 0;
+  using Print::write;
+  virtual int read(uint8_t *buf, size_t size) = 0;
+  using Stream::read;
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+  virtual operator bool() = 0;
+};
+
+// standard output, the CLI of the host build
+class HardwareSerial : public Stream {
+public:
+  size_t write(uint8_t c) override { return fputc(c, stdout) == EOF ? 0 : 1; }
+  size_t write(const uint8_t *buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+
+/*
+  The subset of ArduinoHttpClient 0.6.1 used by the sinks, with the same wire format: request line and headers are
+  written as they are sent, the body is written through the Print interface, and only the status line and the headers
+  of the response are parsed.
+*/
+
+class HttpClient : public Client {
+  Client &client;
+  const char *host;
+  uint16_t port;
+  enum { STATUS, HEADERS, BODY } state = STATUS;
+  // end of headers detection: count of consecutive line terminator characters
+  int newlines = 0;
+  uint32_t responseTimeout = kHttpResponseTimeout;
+
+  void line(const char *a, const char *b = "", const char *c = "", const char *d = "");
+
+public:
+  static const int kHttpPort = 80, kHttpsPort = 443;
+  static const uint32_t kHttpResponseTimeout = 30 * 1000;
+
+  HttpClient(Client &client, const char *host, uint16_t port = kHttpPort) : client(client), host(host), port(port) {}
+
+  void beginRequest() {}
+  void noDefaultRequestHeaders() {}
+  void connectionKeepAlive() {}
+  int post(const char *path);
+  void sendHeader(const char *name, const char *value) { line(name, ": ", value); }
+  void sendHeader(const char *name, int value);
+  void beginBody() { line(""); }
+  void endRequest() { client.flush(); }
+  int responseStatusCode();
+  bool endOfHeadersReached() { return state == BODY; }
+  int readHeader();
+
+  int connect(IPAddress ip, uint16_t port) override { return client.connect(ip, port); }
+  int connect(const char *host, uint16_t port) override { return client.connect(host, port); }
+  size_t write(uint8_t c) override { return client.write(c); }
+  size_t write(const uint8_t *buffer, size_t size) override { return client.write(buffer, size); }
+  using Print::write;
+  int available() override { return client.available(); }
+  int read() override { return client.read(); }
+  int read(uint8_t *buffer, size_t size) override { return client.read(buffer, size); }
+  int peek() override { return client.peek(); }
+  void flush() override { client.flush(); }
+  void stop() override { client.stop(); }
+  uint8_t connected() override { return client.connected(); }
+  operator bool() override { return bool(client); }
+};
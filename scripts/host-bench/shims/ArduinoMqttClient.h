@@ -0,0 +1,30 @@
+#pragma once
+
+#include <Arduino.h>
+
+/*
+  MQTT is not benchmarked on the host, the client always fails to connect.
+*/
+
+class MqttClient : public Client {
+public:
+  MqttClient(Client &) {}
+  void setId(const char *) {}
+  void setUsernamePassword(const char *, const char *) {}
+  void setCleanSession(bool) {}
+  int connect(const char *, uint16_t) override { return 0; }
+  int connect(IPAddress, uint16_t) override { return 0; }
+  int connectError() const { return -1; }
+  int beginMessage(const char *, unsigned long, bool, uint8_t) { return 0; }
+  int endMessage() { return 0; }
+  void poll() {}
+  size_t write(uint8_t) override { return 0; }
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int read(uint8_t *, size_t) override { return -1; }
+  int peek() override { return -1; }
+  void stop() override {}
+  uint8_t connected() override { return 0; }
+  operator bool() override { return false; }
+};
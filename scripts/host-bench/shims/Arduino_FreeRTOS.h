@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+  The subset of the FreeRTOS API used by the upload path, implemented on host threads: tasks are detached threads
+  (priorities are ignored), queues and mutexes are heap allocated, and the static buffers are unused.
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+typedef uint32_t TickType_t;
+typedef uint32_t EventBits_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t StackType_t;
+typedef void *TaskHandle_t, *QueueHandle_t, *SemaphoreHandle_t, *TimerHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t);
+
+struct StaticTask_t {};
+struct StaticQueue_t {};
+struct StaticTimer_t {};
+typedef StaticQueue_t StaticSemaphore_t;
+
+#define configMINIMAL_STACK_SIZE 100
+#define configMAX_PRIORITIES 10
+#define tskIDLE_PRIORITY 0
+#define portMAX_DELAY 0xffffffffu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(x) ((TickType_t)(x))
+#define pdTRUE 1
+#define pdFALSE 0
+
+#define configASSERT(x)                                                                                                \
+  do {                                                                                                                 \
+    if (!(x)) {                                                                                                        \
+      fprintf(stderr, "%s:%d: assertion failed: %s\n", __FILE__, __LINE__, #x);                                       \
+      abort();                                                                                                         \
+    }                                                                                                                  \
+  } while (0)
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t task, const char *name, uint32_t stackDepth, void *arg,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *buffer);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t *storage, StaticQueue_t *buffer);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t timeout);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout);
+BaseType_t xQueueReset(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t *buffer);
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t mutex, TickType_t timeout);
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t mutex);
+
+// timers only back the SD card sync, and there is no SD card: they never fire
+TimerHandle_t xTimerCreateStatic(const char *name, TickType_t period, UBaseType_t autoReload, void *id,
+                                 TimerCallbackFunction_t callback, StaticTimer_t *buffer);
+void *pvTimerGetTimerID(TimerHandle_t timer);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t timeout);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t timeout);
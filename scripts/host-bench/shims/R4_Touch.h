@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+// only the types used by the configuration structs
+
+typedef enum e_ctsu_ico_gain { CTSU_ICO_GAIN_100, CTSU_ICO_GAIN_66, CTSU_ICO_GAIN_50, CTSU_ICO_GAIN_40 } ctsu_ico_gain_t;
+typedef enum e_ctsu_clock_div { CTSU_CLOCK_DIV_2, CTSU_CLOCK_DIV_18 = 8, CTSU_CLOCK_DIV_64 = 31 } ctsu_clock_div_t;
+
+struct ctsu_pin_settings_t {
+  ctsu_clock_div_t div;
+  ctsu_ico_gain_t gain;
+  uint8_t ref_current;
+  uint16_t offset;
+  uint8_t count;
+};
+
+class TouchSensor {};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Arduino.h>
+
+/*
+  There is no SD card in the host build: begin() fails, so netstats logging and the CSV log are skipped.
+*/
+
+#define O_READ 0x01
+#define O_WRITE 0x02
+#define O_RDWR (O_READ | O_WRITE)
+#define O_APPEND 0x04
+#define O_CREAT 0x10
+
+class SdFile {
+public:
+  bool truncate(uint32_t) { return false; }
+  bool sync() { return false; }
+};
+
+class File : public Stream {
+  SdFile *_file = nullptr;
+
+public:
+  size_t write(uint8_t) override { return 0; }
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int read(void *, size_t) { return -1; }
+  int peek() override { return -1; }
+  bool seek(uint32_t) { return false; }
+  uint32_t size() { return 0; }
+  void close() {}
+  operator bool() { return false; }
+};
+
+struct cid_t {
+  uint8_t bytes[16];
+};
+
+class Sd2Card {
+public:
+  bool readCID(cid_t *) { return false; }
+};
+
+class SDClass {
+  Sd2Card card;
+
+public:
+  bool begin(uint8_t) { return false; }
+  void end() {}
+  File open(const char *, uint8_t = O_READ) { return {}; }
+  bool exists(const char *) { return false; }
+  bool mkdir(const char *) { return false; }
+};
+
+extern SDClass SD;
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Arduino.h>
+
+/*
+  The WiFi link is always up in the host build. Name resolution uses the host resolver, but every name resolves to the
+  stub server, see WiFiSSLClient.h.
+*/
+
+#define WIFI_FIRMWARE_LATEST_VERSION "0.4.1"
+#define WL_CONNECTED 3
+
+class CWifi {
+public:
+  int hostByName(const char *host, IPAddress &ip);
+  uint8_t *macAddress(uint8_t *mac);
+};
+
+extern CWifi WiFi;
+
+class WiFiClient : public Client {};
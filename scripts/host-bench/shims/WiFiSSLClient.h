@@ -0,0 +1,33 @@
+#pragma once
+
+#include "WiFiS3.h"
+
+/*
+  TLS client on OpenSSL. All connections go to the stub server set with hostStubServer(), whatever the requested host
+  and port, so the upload code runs unchanged against the production URNs. The host name is still sent as SNI, and the
+  server certificate is not verified.
+*/
+
+void hostStubServer(const char *host, uint16_t port);
+
+class WiFiSSLClient : public WiFiClient {
+  struct Connection;
+  Connection *connection = nullptr;
+  int peeked = -1;
+
+public:
+  ~WiFiSSLClient() override;
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buffer, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#define CMB_CALL_STACK_MAX_DEPTH 16
+
+inline size_t cm_backtrace_call_stack(uint32_t *, size_t, uint32_t) { return 0; }
+inline uint32_t cmb_get_sp() { return 0; }
@@ -0,0 +1,429 @@
+/*
+  Host implementation of the platform pieces that the upload path links against: Arduino core, FreeRTOS, the WiFi
+  module (TLS via OpenSSL), and the few firmware symbols that live in translation units not built on the host.
+*/
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <netdb.h>
+#include <unistd.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include "blastic.h"
+#include <ArduinoHttpClient.h>
+
+// Arduino core
+
+static const auto startTime = std::chrono::steady_clock::now();
+
+unsigned long millis() {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(steady_clock::now() - startTime).count();
+}
+
+unsigned long micros() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+char *dtostrf(double value, signed char width, unsigned char precision, char *buffer) {
+  sprintf(buffer, "%*.*f", width, precision, value);
+  return buffer;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+  while (size-- && write(*buffer++)) n++;
+  return n;
+}
+
+size_t Print::print(long n, int base) {
+  if (base != 10) return print((unsigned long)n, base);
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%ld", n);
+  return write(buffer);
+}
+
+size_t Print::print(unsigned long n, int base) { return print((unsigned long long)n, base); }
+
+size_t Print::print(long long n, int base) {
+  if (base != 10) return print((unsigned long long)n, base);
+  char buffer[24];
+  snprintf(buffer, sizeof(buffer), "%lld", n);
+  return write(buffer);
+}
+
+size_t Print::print(unsigned long long n, int base) {
+  char buffer[66], *digit = buffer + sizeof(buffer) - 1;
+  *digit = '\0';
+  if (base < 2) base = 10;
+  do *--digit = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"[n % base];
+  while (n /= base);
+  return write(digit);
+}
+
+size_t Print::print(double n, int digits) {
+  if (std::isnan(n)) return print("nan");
+  if (std::isinf(n)) return print("inf");
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, n);
+  return write(buffer);
+}
+
+HardwareSerial Serial;
+
+// FreeRTOS
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t task, const char *, uint32_t, void *arg, UBaseType_t, StackType_t *,
+                               StaticTask_t *buffer) {
+  std::thread(task, arg).detach();
+  return buffer;
+}
+
+void vTaskDelete(TaskHandle_t) {}
+
+void vTaskDelay(TickType_t ticks) { delay(ticks * portTICK_PERIOD_MS); }
+
+namespace {
+
+template <typename Lock, typename Predicate>
+bool waitFor(std::condition_variable &cv, Lock &lock, TickType_t timeout, Predicate &&predicate) {
+  if (timeout == portMAX_DELAY) {
+    cv.wait(lock, predicate);
+    return true;
+  }
+  return cv.wait_for(lock, std::chrono::milliseconds(timeout * portTICK_PERIOD_MS), predicate);
+}
+
+struct HostQueue {
+  const size_t length, itemSize;
+  std::deque<std::vector<uint8_t>> items;
+  std::mutex mutex;
+  std::condition_variable changed;
+};
+
+struct HostMutex {
+  std::mutex mutex;
+  std::condition_variable released;
+  std::thread::id owner;
+  size_t depth = 0;
+};
+
+} // namespace
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t *, StaticQueue_t *) {
+  return new HostQueue{length, itemSize};
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t timeout) {
+  auto &queue = *static_cast<HostQueue *>(handle);
+  std::unique_lock lock(queue.mutex);
+  if (!waitFor(queue.changed, lock, timeout, [&]() { return queue.items.size() < queue.length; })) return pdFALSE;
+  auto bytes = static_cast<const uint8_t *>(item);
+  queue.items.emplace_back(bytes, bytes + queue.itemSize);
+  queue.changed.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t timeout) {
+  auto &queue = *static_cast<HostQueue *>(handle);
+  std::unique_lock lock(queue.mutex);
+  if (!waitFor(queue.changed, lock, timeout, [&]() { return !queue.items.empty(); })) return pdFALSE;
+  memcpy(item, queue.items.front().data(), queue.itemSize);
+  queue.items.pop_front();
+  queue.changed.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t handle) {
+  auto &queue = *static_cast<HostQueue *>(handle);
+  std::unique_lock lock(queue.mutex);
+  queue.items.clear();
+  queue.changed.notify_all();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) {
+  auto &queue = *static_cast<HostQueue *>(handle);
+  std::unique_lock lock(queue.mutex);
+  return queue.items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutexStatic(StaticSemaphore_t *) { return new HostMutex; }
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t handle, TickType_t timeout) {
+  auto &mutex = *static_cast<HostMutex *>(handle);
+  auto self = std::this_thread::get_id();
+  std::unique_lock lock(mutex.mutex);
+  if (!waitFor(mutex.released, lock, timeout, [&]() { return !mutex.depth || mutex.owner == self; })) return pdFALSE;
+  mutex.owner = self;
+  mutex.depth++;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t handle) {
+  auto &mutex = *static_cast<HostMutex *>(handle);
+  std::unique_lock lock(mutex.mutex);
+  if (!mutex.depth || mutex.owner != std::this_thread::get_id()) return pdFALSE;
+  if (!--mutex.depth) mutex.released.notify_all();
+  return pdTRUE;
+}
+
+TimerHandle_t xTimerCreateStatic(const char *, TickType_t, UBaseType_t, void *id, TimerCallbackFunction_t,
+                                 StaticTimer_t *) {
+  return id;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer) { return timer; }
+
+BaseType_t xTimerChangePeriod(TimerHandle_t, TickType_t, TickType_t) { return pdTRUE; }
+
+BaseType_t xTimerStop(TimerHandle_t, TickType_t) { return pdTRUE; }
+
+// WiFi module
+
+CWifi WiFi;
+
+static const char *stubHost = "127.0.0.1";
+static uint16_t stubPort = 8443;
+
+void hostStubServer(const char *host, uint16_t port) { stubHost = host, stubPort = port; }
+
+int CWifi::hostByName(const char *, IPAddress &ip) {
+  addrinfo hints{}, *result;
+  hints.ai_family = AF_INET;
+  if (getaddrinfo(stubHost, nullptr, &hints, &result)) return 0;
+  ip = IPAddress(reinterpret_cast<sockaddr_in *>(result->ai_addr)->sin_addr.s_addr);
+  freeaddrinfo(result);
+  return 1;
+}
+
+uint8_t *CWifi::macAddress(uint8_t *mac) {
+  constexpr const uint8_t hostMac[6]{0x02, 0, 0, 0, 0, 0x01};
+  return static_cast<uint8_t *>(memcpy(mac, hostMac, sizeof(hostMac)));
+}
+
+struct WiFiSSLClient::Connection {
+  int socket = -1;
+  SSL *ssl = nullptr;
+
+  ~Connection() {
+    if (ssl) {
+      SSL_shutdown(ssl);
+      SSL_free(ssl);
+    }
+    if (socket >= 0) close(socket);
+  }
+};
+
+static SSL_CTX *sslContext() {
+  static SSL_CTX *context = []() {
+    auto context = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(context, SSL_VERIFY_NONE, nullptr);
+    return context;
+  }();
+  return context;
+}
+
+WiFiSSLClient::~WiFiSSLClient() { stop(); }
+
+int WiFiSSLClient::connect(IPAddress, uint16_t port) { return connect(stubHost, port); }
+
+int WiFiSSLClient::connect(const char *host, uint16_t) {
+  stop();
+  addrinfo hints{}, *result;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  char port[8];
+  snprintf(port, sizeof(port), "%u", stubPort);
+  if (getaddrinfo(stubHost, port, &hints, &result)) return 0;
+  connection = new Connection;
+  connection->socket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+  auto connected = connection->socket >= 0 && !::connect(connection->socket, result->ai_addr, result->ai_addrlen);
+  freeaddrinfo(result);
+  if (connected) {
+    connection->ssl = SSL_new(sslContext());
+    SSL_set_fd(connection->ssl, connection->socket);
+    SSL_set_tlsext_host_name(connection->ssl, host);
+    connected = SSL_connect(connection->ssl) == 1;
+  }
+  if (!connected) stop();
+  return connected;
+}
+
+size_t WiFiSSLClient::write(const uint8_t *buffer, size_t size) {
+  if (!connection || !size) return 0;
+  auto written = SSL_write(connection->ssl, buffer, size);
+  return written > 0 ? written : 0;
+}
+
+int WiFiSSLClient::available() {
+  if (!connection) return 0;
+  if (peeked >= 0) return 1;
+  // like the WiFi module, report only data that can be read without blocking
+  int pending = SSL_pending(connection->ssl);
+  if (pending) return pending;
+  timeval noWait{};
+  fd_set readable;
+  FD_ZERO(&readable);
+  FD_SET(connection->socket, &readable);
+  if (select(connection->socket + 1, &readable, nullptr, nullptr, &noWait) <= 0) return 0;
+  peeked = read();
+  return peeked >= 0;
+}
+
+int WiFiSSLClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiSSLClient::read(uint8_t *buffer, size_t size) {
+  if (!size) return 0;
+  if (peeked >= 0) {
+    *buffer = peeked;
+    peeked = -1;
+    return 1;
+  }
+  if (!connection) return -1;
+  auto n = SSL_read(connection->ssl, buffer, size);
+  if (n <= 0) {
+    stop();
+    return -1;
+  }
+  return n;
+}
+
+int WiFiSSLClient::peek() {
+  if (peeked < 0) peeked = read();
+  return peeked;
+}
+
+void WiFiSSLClient::stop() {
+  delete connection;
+  connection = nullptr;
+  peeked = -1;
+}
+
+uint8_t WiFiSSLClient::connected() { return connection || peeked >= 0; }
+
+// ArduinoHttpClient subset
+
+void HttpClient::line(const char *a, const char *b, const char *c, const char *d) {
+  print(a);
+  print(b);
+  print(c);
+  print(d);
+  print("\r\n");
+}
+
+int HttpClient::post(const char *path) {
+  if (!client.connected() && !client.connect(host, port)) return -1;
+  state = STATUS;
+  newlines = 0;
+  line("POST ", path, " HTTP/1.1");
+  return 0;
+}
+
+void HttpClient::sendHeader(const char *name, int value) {
+  char number[16];
+  snprintf(number, sizeof(number), "%d", value);
+  line(name, ": ", number);
+}
+
+int HttpClient::responseStatusCode() {
+  char statusLine[64];
+  size_t length = 0;
+  for (auto start = millis(); millis() - start < responseTimeout;) {
+    if (!client.available()) {
+      if (!client.connected()) return -3;
+      delay(1);
+      continue;
+    }
+    auto c = client.read();
+    if (c == '\n') {
+      statusLine[length] = '\0';
+      int code;
+      if (sscanf(statusLine, "HTTP/%*s %d", &code) != 1) return -4;
+      // 1xx responses are followed by the final one
+      if (code >= 100 && code < 200) {
+        length = 0;
+        continue;
+      }
+      state = HEADERS;
+      newlines = 1;
+      return code;
+    }
+    if (length < sizeof(statusLine) - 1) statusLine[length++] = c;
+  }
+  return -2;
+}
+
+int HttpClient::readHeader() {
+  auto c = client.read();
+  if (state == HEADERS && c >= 0) {
+    if (c == '\n') {
+      if (++newlines == 2) state = BODY;
+    } else if (c != '\r') newlines = 0;
+  }
+  return c;
+}
+
+// firmware symbols from translation units that are not part of the host build
+
+SDClass SD;
+
+namespace wifi {
+
+uint32_t debug = 0;
+
+Layer3::Layer3(const Networks &, uint8_t) : util::Mutexed<::WiFi>(), backgroundJob(false) {}
+Layer3::operator bool() const { return true; }
+Layer3::~Layer3() {}
+bool Layer3::firmwareCompatible() { return true; }
+
+SSLClient::ReadStats SSLClient::readStats{};
+int SSLClient::read() { return WiFiSSLClient::read(); }
+int SSLClient::read(uint8_t *buffer, size_t size) { return WiFiSSLClient::read(buffer, size); }
+
+} // namespace wifi
+
+namespace ntp {
+
+static int httpEpoch, httpEpochMillis;
+
+int unixTime() { return httpEpoch ? httpEpoch + (millis() - httpEpochMillis) / 1000 : 0; }
+bool stale() { return !httpEpoch; }
+
+bool syncFromHttpDate(const char *date) {
+  tm time{};
+  if (!strptime(date, " %a, %d %b %Y %H:%M:%S GMT", &time)) return false;
+  httpEpoch = timegm(&time);
+  httpEpochMillis = millis();
+  return true;
+}
+
+} // namespace ntp
+
+namespace blastic {
+
+uint32_t debug = 0;
+Config config;
+
+namespace boot {
+
+// a terminal is there from the start, the console writes through
+Console console;
+
+size_t Console::write(const uint8_t *data, size_t size) { return Serial.write(data, size); }
+
+bool Console::release() { return true; }
+
+} // namespace boot
+
+} // namespace blastic
@@ -0,0 +1,192 @@
+#!/bin/env python
+
+"""
+Local stand-in for the Google Form and JSON endpoints, for upload-bench. Accepts HTTPS POST requests on any path:
+
+  application/x-www-form-urlencoded   one form entry, checked for the four form fields
+  application/json                    a batch, checked for the measurements array
+
+and answers 200, or 400 for malformed bodies. Faults can be injected with a probability per request: latency before
+the response, error status codes, responses trickled slowly, and connections dropped without a response. A summary is
+printed every few seconds and on exit.
+"""
+
+import argparse
+import email.utils
+import json
+import os
+import random
+import signal
+import socketserver
+import ssl
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import urllib.parse
+from collections import Counter
+
+FORM_FIELDS = ("entry.485899545", "entry.1447667805", "entry.436217948", "entry.1288178639")
+
+stats = Counter()
+stats_lock = threading.Lock()
+
+
+def count(*keys, n=1):
+    with stats_lock:
+        for key in keys:
+            stats[key] += n
+
+
+def validate(content_type, body):
+    """Returns the number of measurements in a well formed body, or None."""
+    try:
+        if content_type.startswith("application/x-www-form-urlencoded"):
+            form = urllib.parse.parse_qs(body.decode(), strict_parsing=True)
+            return 1 if all(field in form for field in FORM_FIELDS) else None
+        if content_type.startswith("application/json"):
+            batch = json.loads(body)
+            measurements = batch["measurements"]
+            if all({"epoch", "type", "weight"} <= set(m) for m in measurements):
+                return len(measurements)
+    except (ValueError, KeyError, TypeError):
+        pass
+    return None
+
+
+class StubHandler(socketserver.StreamRequestHandler):
+    def read_request(self):
+        request_line = self.rfile.readline()
+        if not request_line:
+            return None
+        method, path, _ = request_line.decode(errors="replace").split(" ", 2)
+        headers = {}
+        while True:
+            line = self.rfile.readline().decode(errors="replace").strip()
+            if not line:
+                break
+            name, _, value = line.partition(":")
+            headers[name.strip().lower()] = value.strip()
+        body = self.rfile.read(int(headers.get("content-length", 0)))
+        return method, path, headers, body
+
+    def respond(self, code, reason, slow):
+        body = f"{code} {reason}\n".encode()
+        response = (f"HTTP/1.1 {code} {reason}\r\nDate: {email.utils.formatdate(usegmt=True)}\r\n"
+                    f"Content-Type: text/plain\r\nContent-Length: {len(body)}\r\n\r\n").encode() + body
+        if not slow:
+            self.wfile.write(response)
+            return
+        for i in range(len(response)):
+            self.wfile.write(response[i:i + 1])
+            self.wfile.flush()
+            time.sleep(self.server.args.slow_time / len(response))
+
+    def handle(self):
+        args = self.server.args
+        count("connections")
+        while True:
+            try:
+                request = self.read_request()
+            except (OSError, ValueError):
+                return
+            if not request:
+                return
+            method, path, headers, body = request
+            count("requests")
+            if random.random() < args.drop_rate:
+                count("dropped")
+                return
+            delay = args.latency + random.uniform(0, args.jitter)
+            time.sleep(delay / 1000)
+            measurements = validate(headers.get("content-type", ""), body)
+            if method != "POST" or measurements is None:
+                code, reason = 400, "Bad Request"
+            elif random.random() < args.error_rate:
+                code, reason = args.error_code, "Injected Error"
+            else:
+                code, reason = 200, "OK"
+                count("measurements", n=measurements)
+            count(f"status {code}")
+            slow = random.random() < args.slow_rate
+            if slow:
+                count("slow")
+            try:
+                self.respond(code, reason, slow)
+            except OSError:
+                # the sinks close the connection after the headers
+                count("closed during response")
+                return
+            if headers.get("connection", "").lower() == "close":
+                return
+
+
+class TLSServer(socketserver.ThreadingMixIn, socketserver.TCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+    def __init__(self, address, context, args):
+        super().__init__(address, StubHandler)
+        self.context = context
+        self.args = args
+
+    def get_request(self):
+        sock, address = super().get_request()
+        return self.context.wrap_socket(sock, server_side=True), address
+
+    def handle_error(self, request, client_address):
+        count("tls or socket errors")
+
+
+def self_signed_certificate(directory):
+    cert, key = os.path.join(directory, "cert.pem"), os.path.join(directory, "key.pem")
+    subprocess.check_call(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-keyout", key, "-out", cert,
+                           "-days", "30", "-subj", "/CN=localhost"], stderr=subprocess.DEVNULL)
+    return cert, key
+
+
+def print_stats():
+    with stats_lock:
+        summary = ", ".join(f"{key} {value}" for key, value in sorted(stats.items()))
+    print(f"stub-server: {summary or 'no requests'}", flush=True)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=8443)
+    parser.add_argument("--cert", help="server certificate, a self-signed one is generated if missing")
+    parser.add_argument("--key", help="server certificate key")
+    parser.add_argument("--latency", type=float, default=0, help="milliseconds before each response")
+    parser.add_argument("--jitter", type=float, default=0, help="random extra milliseconds before each response")
+    parser.add_argument("--error-rate", type=float, default=0, help="probability of an error status")
+    parser.add_argument("--error-code", type=int, default=503)
+    parser.add_argument("--slow-rate", type=float, default=0, help="probability of a slowly trickled response")
+    parser.add_argument("--slow-time", type=float, default=2, help="seconds to send a slow response")
+    parser.add_argument("--drop-rate", type=float, default=0, help="probability of closing without a response")
+    parser.add_argument("--stats-interval", type=float, default=10)
+    args = parser.parse_args()
+
+    def report():
+        while True:
+            time.sleep(args.stats_interval)
+            print_stats()
+
+    signal.signal(signal.SIGTERM, lambda *_: sys.exit(0))
+    with tempfile.TemporaryDirectory() as directory:
+        cert, key = (args.cert, args.key) if args.cert else self_signed_certificate(directory)
+        context = ssl.create_default_context(ssl.Purpose.CLIENT_AUTH)
+        context.load_cert_chain(cert, key)
+        with TLSServer(("127.0.0.1", args.port), context, args) as server:
+            print(f"stub-server: listening on 127.0.0.1:{args.port}", flush=True)
+            threading.Thread(target=report, daemon=True).start()
+            try:
+                server.serve_forever()
+            except KeyboardInterrupt:
+                pass
+            finally:
+                print_stats()
+
+
+if __name__ == "__main__":
+    main()
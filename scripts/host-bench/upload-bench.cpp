@@ -0,0 +1,118 @@
+/*
+  Host benchmark of the upload path: measurements are pushed to the real sinks::Dispatcher, which submits them to the
+  stub server (stub-server.py) through the real sinks code. Two modes:
+
+    interactive   one measurement at a time, waiting for the reports like the Submitter does
+    burst         all the measurements queued at once, so that the dispatcher batches them
+
+  Prints the end-to-end submissions per second, the latency distribution of the submissions, the outcome of each
+  sink, and the netstats phase summary.
+*/
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include "blastic.h"
+#include "Sinks.h"
+#include "netstats.h"
+
+using namespace blastic;
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [--server host:port] [--sink form|json|both] [--mode interactive|burst] [--count n] [--debug]\n",
+          argv0);
+  exit(2);
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, unsigned p) {
+  return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, sorted.size() * p / 100)];
+}
+
+int main(int argc, char **argv) {
+  static const option options[]{{"server", required_argument, nullptr, 's'},
+                                {"sink", required_argument, nullptr, 'k'},
+                                {"mode", required_argument, nullptr, 'm'},
+                                {"count", required_argument, nullptr, 'n'},
+                                {"debug", no_argument, nullptr, 'd'},
+                                {}};
+  std::string server = "127.0.0.1:8443", sink = "form", mode = "interactive";
+  size_t count = 100;
+  for (int option; (option = getopt_long(argc, argv, "", options, nullptr)) != -1;) {
+    switch (option) {
+    case 's': server = optarg; break;
+    case 'k': sink = optarg; break;
+    case 'm': mode = optarg; break;
+    case 'n': count = strtoul(optarg, nullptr, 10); break;
+    case 'd': debug = 1; break;
+    default: usage(argv[0]);
+    }
+  }
+  auto colon = server.rfind(':');
+  if (colon == std::string::npos || !count || (sink != "form" && sink != "json" && sink != "both") ||
+      (mode != "interactive" && mode != "burst"))
+    usage(argv[0]);
+  static std::string serverHost = server.substr(0, colon);
+  hostStubServer(serverHost.c_str(), atoi(server.c_str() + colon + 1));
+
+  // the production Precious Plastic form, and a JSON endpoint on the stub
+  config.submit.collectionPoint = "BlastPersis";
+  config.submit.collectorName = "BSPers";
+  config.submit.spacesWorkaroundPPForm = true;
+  config.submit.skipPPForm = sink == "json";
+  if (sink != "form") config.submit.json.urn = "localhost/json";
+  sinks::configChanged();
+  auto &dispatcher = sinks::dispatcher();
+
+  std::map<std::string, size_t> outcomes;
+  auto receiveReports = [&]() {
+    for (sinks::Report report; dispatcher.receiveReport(report, pdMS_TO_TICKS(120000));) {
+      if (report.link != sinks::Report::NO_ERROR) outcomes[report.link == sinks::Report::WIFI ? "wifi" : "firmware"]++;
+      else if (report.sink) {
+        std::string name = *report.sink->name ? report.sink->name : "pp";
+        switch (report.result.state) {
+        case sinks::State::OK: name += " ok"; break;
+        case sinks::State::ERROR: name += " error"; break;
+        case sinks::State::REJECTED: name += " http " + std::to_string(report.result.code); break;
+        case sinks::State::UNCONFIGURED: name += " unconfigured"; break;
+        }
+        outcomes[name]++;
+      }
+      if (report.last) return true;
+    }
+    return false;
+  };
+
+  std::vector<uint32_t> latencies;
+  auto start = millis();
+  for (size_t i = 0; i < count; i++) {
+    sinks::Measurement measurement{int32_t(1700000000 + i), 0.25f + i % 100, plastics[i % std::size(plastics)]};
+    auto pushed = millis();
+    // in a burst only the last measurement requests the reports, which come with the last batch
+    bool report = mode == "interactive" || i == count - 1;
+    while (!dispatcher.push(measurement, report, pdMS_TO_TICKS(1000)))
+      ;
+    if (!report) continue;
+    if (!receiveReports()) outcomes["report timeout"]++;
+    latencies.push_back(millis() - pushed);
+  }
+  auto elapsed = millis() - start;
+
+  std::sort(latencies.begin(), latencies.end());
+  printf("upload-bench: %zu submissions (%s, %s) in %.3f s, %.2f submissions/s\n", count, sink.c_str(), mode.c_str(),
+         elapsed / 1000., elapsed ? count * 1000. / elapsed : 0.);
+  if (mode == "burst") printf("upload-bench: sink outcomes of the last batch only\n");
+  else
+    printf("upload-bench: latency ms p50 %u p90 %u p99 %u max %u\n", percentile(latencies, 50),
+           percentile(latencies, 90), percentile(latencies, 99), latencies.back());
+  for (auto &[outcome, n] : outcomes) printf("upload-bench: %s %zu\n", outcome.c_str(), n);
+  using namespace netstats;
+  for (size_t phase = 0; phase < size_t(Phase::count); phase++) {
+    auto summary = netstats::summary(Phase(phase));
+    if (!summary.count) continue;
+    printf("upload-bench: phase %s count %u min %u avg %u p95 %u max %u ms (last %zu)\n", phaseNames[phase],
+           summary.count, summary.min, summary.avg, summary.p95, summary.max, std::min<size_t>(summary.count, window));
+  }
+}
@@ -0,0 +1,344 @@
+/*
+  Host side of the binary RPC of the CLI (include/Rpc.h): run commands and read or write config fields over the USB
+  serial port, with framed and CRC-checked requests and responses instead of parsing the text output.
+
+    blastic-rpc <tty> call <command> [args...]   run a command, print its output; fails if the command does not exist
+    blastic-rpc <tty> get <field>                print a config field, e.g. config.scale.mode or scale.mode
+    blastic-rpc <tty> set <field> <value>        set a config field (not saved until `call eeprom::save`)
+    blastic-rpc <tty> fields                     list the config fields with their type and size
+
+  Text printed by the scale around the responses goes to stderr. The exit status is 0 on success, 1 on errors. Build
+  with
+
+    g++ -std=gnu++17 -O2 scripts/rpc/blastic-rpc.cpp -o blastic-rpc
+*/
+
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "../../include/murmur32.h"
+
+namespace {
+
+// keep in sync with include/Rpc.h and include/ConfigSchema.h
+struct Header {
+  uint16_t id;
+  uint8_t type, status;
+} __attribute__((packed));
+
+enum Type : uint8_t { CALL = 1, GET, SET, FIELDS };
+enum Status : uint8_t { OK, MORE, BAD_REQUEST, UNKNOWN_TYPE, NOT_FOUND, INVALID };
+const char *statusNames[]{"ok", "more", "bad request", "unknown type", "not found", "invalid value"};
+
+enum class FieldType : uint8_t {
+  BOOL,
+  UINT8,
+  UINT16,
+  UINT32,
+  INT32,
+  FLOAT,
+  ANNOTATED_FLOAT,
+  STRING,
+  HX711_MODE,
+  CTSU_GAIN,
+  CTSU_DIV
+};
+const char *typeNames[]{"bool", "uint8", "uint16", "uint32", "int32", "float", "float", "string", "mode", "gain",
+                        "div"};
+const char *modeNames[]{"A128", "B", "A64"};
+const int gains[]{100, 66, 50, 40};
+
+constexpr const int responseTimeout = 10000;
+
+uint32_t crc32(const uint8_t *data, size_t length) {
+  uint32_t crc = ~0u;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1));
+  }
+  return ~crc;
+}
+
+std::vector<uint8_t> cobsEncode(const std::vector<uint8_t> &src) {
+  std::vector<uint8_t> dst{0};
+  size_t code = 0;
+  for (auto c : src) {
+    if (c) dst.push_back(c);
+    if (!c || dst.size() - code == 0xff) {
+      dst[code] = dst.size() - code;
+      code = dst.size();
+      dst.push_back(0);
+    }
+  }
+  dst[code] = dst.size() - code;
+  return dst;
+}
+
+bool cobsDecode(const std::vector<uint8_t> &src, std::vector<uint8_t> &dst) {
+  dst.clear();
+  for (size_t i = 0; i < src.size();) {
+    uint8_t code = src[i++];
+    if (!code || i + code - 1 > src.size()) return false;
+    dst.insert(dst.end(), src.begin() + i, src.begin() + i + code - 1);
+    i += code - 1;
+    if (code != 0xff && i < src.size()) dst.push_back(0);
+  }
+  return true;
+}
+
+int openSerial(const char *path) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    perror(path);
+    exit(1);
+  }
+  termios tio;
+  if (tcgetattr(fd, &tio)) {
+    perror("tcgetattr");
+    exit(1);
+  }
+  cfmakeraw(&tio);
+  // the ESP32-S3 USB bridge applies this line coding to the UART of the RA4M1, it must match BLASTIC_MONITOR_SPEED
+  cfsetspeed(&tio, B115200);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  tcsetattr(fd, TCSANOW, &tio);
+  tcflush(fd, TCIOFLUSH);
+  return fd;
+}
+
+class Connection {
+  int fd;
+  uint16_t lastId;
+  std::vector<uint8_t> segment, payload;
+  // read but not parsed yet
+  uint8_t buffer[4096];
+  size_t position = 0, length = 0;
+  bool inFrame = false;
+
+public:
+  Connection(const char *path) : fd(openSerial(path)), lastId(getpid()) {}
+
+  uint16_t send(Type type, const std::vector<uint8_t> &body) {
+    Header header{++lastId, type, 0};
+    std::vector<uint8_t> frame(reinterpret_cast<uint8_t *>(&header), reinterpret_cast<uint8_t *>(&header + 1));
+    frame.insert(frame.end(), body.begin(), body.end());
+    auto crc = crc32(frame.data(), frame.size());
+    frame.insert(frame.end(), reinterpret_cast<uint8_t *>(&crc), reinterpret_cast<uint8_t *>(&crc + 1));
+    auto encoded = cobsEncode(frame);
+    encoded.insert(encoded.begin(), 0);
+    encoded.push_back(0);
+    if (write(fd, encoded.data(), encoded.size()) != ssize_t(encoded.size())) {
+      perror("write");
+      exit(1);
+    }
+    return header.id;
+  }
+
+  /*
+    The next response to request id: text goes to textOut, or stderr, and responses to other requests are skipped.
+    Both sides of a frame are zero bytes, so a damaged frame or one that began before we started reading makes the
+    closing zero look like an opening one: text until the next zero is then taken as a frame, discarded, and the
+    reading is aligned again.
+  */
+  Status receive(uint16_t id, std::vector<uint8_t> &body, FILE *textOut = stderr) {
+    while (true) {
+      while (position < length) {
+        auto c = buffer[position++];
+        if (!inFrame) {
+          if (c) fputc(c, textOut);
+          else inFrame = true;
+          continue;
+        }
+        if (c) {
+          segment.push_back(c);
+          continue;
+        }
+        if (segment.empty()) continue;
+        inFrame = false;
+        auto valid = cobsDecode(segment, payload) && payload.size() >= sizeof(Header) + sizeof(uint32_t);
+        segment.clear();
+        uint32_t crc;
+        if (valid) memcpy(&crc, payload.data() + payload.size() - sizeof(crc), sizeof(crc));
+        if (!valid || crc != crc32(payload.data(), payload.size() - sizeof(crc))) {
+          // a damaged frame, or text taken as a frame
+          inFrame = true;
+          continue;
+        }
+        Header header;
+        memcpy(&header, payload.data(), sizeof(header));
+        if (header.id != id) continue;
+        body.assign(payload.begin() + sizeof(header), payload.end() - sizeof(crc));
+        fflush(textOut);
+        return Status(header.status);
+      }
+      pollfd pfd{fd, POLLIN, 0};
+      if (poll(&pfd, 1, responseTimeout) <= 0) {
+        fprintf(stderr, "timeout waiting for a response\n");
+        exit(1);
+      }
+      auto n = read(fd, buffer, sizeof(buffer));
+      if (n <= 0) {
+        perror("read");
+        exit(1);
+      }
+      position = 0;
+      length = n;
+    }
+  }
+};
+
+std::vector<uint8_t> hashBody(std::string name) {
+  if (name.rfind("config.", 0)) name = "config." + name;
+  auto hash = util::murmur3_32(name.c_str());
+  return {reinterpret_cast<uint8_t *>(&hash), reinterpret_cast<uint8_t *>(&hash + 1)};
+}
+
+[[noreturn]] void fail(Status status) {
+  fprintf(stderr, "%s\n", status < std::size(statusNames) ? statusNames[status] : "unknown status");
+  exit(1);
+}
+
+uint32_t readInteger(const uint8_t *value, size_t size) {
+  uint32_t result = 0;
+  memcpy(&result, value, std::min(size, sizeof(result)));
+  return result;
+}
+
+void printValue(const std::vector<uint8_t> &body) {
+  if (body.empty()) fail(BAD_REQUEST);
+  auto type = FieldType(body[0]);
+  auto value = body.data() + 1;
+  auto size = body.size() - 1;
+  auto integer = readInteger(value, size);
+  float f;
+  switch (type) {
+  case FieldType::BOOL:
+  case FieldType::UINT8:
+  case FieldType::UINT16:
+  case FieldType::UINT32: printf("%u\n", integer); break;
+  case FieldType::INT32: printf("%d\n", int32_t(integer)); break;
+  case FieldType::FLOAT:
+  case FieldType::ANNOTATED_FLOAT:
+    memcpy(&f, value, sizeof(f));
+    printf("%f\n", f);
+    break;
+  case FieldType::STRING: printf("'%.*s'\n", int(strnlen(reinterpret_cast<const char *>(value), size)), value); break;
+  case FieldType::HX711_MODE: printf("%s\n", integer < std::size(modeNames) ? modeNames[integer] : "?"); break;
+  case FieldType::CTSU_GAIN: printf("%d\n", integer < std::size(gains) ? gains[integer] : -1); break;
+  case FieldType::CTSU_DIV: printf("%u\n", integer * 2 + 2); break;
+  default: printf("unknown type %u\n", body[0]);
+  }
+}
+
+// the value in the format of the field, as read by a GET
+std::vector<uint8_t> parseValue(FieldType type, size_t size, const char *text) {
+  std::vector<uint8_t> value(size);
+  char *end;
+  uint32_t integer = strtoul(text, &end, 0);
+  auto isInteger = *text && !*end;
+  auto setInteger = [&] {
+    if (!isInteger) {
+      fprintf(stderr, "%s: invalid value\n", text);
+      exit(1);
+    }
+    memcpy(value.data(), &integer, std::min(size, sizeof(integer)));
+  };
+  float f;
+  switch (type) {
+  case FieldType::BOOL:
+  case FieldType::UINT8:
+  case FieldType::UINT16:
+  case FieldType::UINT32:
+  case FieldType::INT32: setInteger(); break;
+  case FieldType::FLOAT:
+  case FieldType::ANNOTATED_FLOAT:
+    f = strtof(text, &end);
+    if (!*text || *end) setInteger();
+    memcpy(value.data(), &f, sizeof(f));
+    break;
+  case FieldType::STRING:
+    if (strlen(text) >= size) {
+      fprintf(stderr, "%s: longer than %zu characters\n", text, size - 1);
+      exit(1);
+    }
+    strcpy(reinterpret_cast<char *>(value.data()), text);
+    break;
+  case FieldType::HX711_MODE:
+    for (integer = 0; integer < std::size(modeNames) && strcmp(text, modeNames[integer]); integer++);
+    isInteger = integer < std::size(modeNames);
+    setInteger();
+    break;
+  case FieldType::CTSU_GAIN: {
+    auto gain = integer;
+    for (integer = 0; integer < std::size(gains) && uint32_t(gains[integer]) != gain; integer++);
+    isInteger = isInteger && integer < std::size(gains);
+    setInteger();
+    break;
+  }
+  case FieldType::CTSU_DIV:
+    isInteger = isInteger && integer >= 2 && !(integer % 2);
+    integer = integer / 2 - 1;
+    setInteger();
+    break;
+  default: fprintf(stderr, "unknown type %u\n", uint8_t(type)); exit(1);
+  }
+  return value;
+}
+
+[[noreturn]] void usage() {
+  fprintf(stderr, "usage: blastic-rpc <tty> call <command> [args...] | get <field> | set <field> <value> | fields\n");
+  exit(1);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3) usage();
+  Connection connection(argv[1]);
+  std::string command = argv[2];
+  std::vector<uint8_t> body;
+  if (command == "call" && argc >= 4) {
+    std::string line;
+    for (int i = 3; i < argc; i++) line += (i > 3 ? " " : "") + std::string(argv[i]);
+    auto id = connection.send(CALL, {line.begin(), line.end()});
+    // the output of the command comes in MORE frames, the log lines of other tasks go to stderr
+    Status status;
+    while ((status = connection.receive(id, body)) == MORE) fwrite(body.data(), 1, body.size(), stdout);
+    if (status != OK) fail(status);
+  } else if (command == "get" && argc == 4) {
+    auto status = connection.receive(connection.send(GET, hashBody(argv[3])), body);
+    if (status != OK) fail(status);
+    printValue(body);
+  } else if (command == "set" && argc == 5) {
+    auto request = hashBody(argv[3]);
+    auto status = connection.receive(connection.send(GET, request), body);
+    if (status != OK || body.empty()) fail(status);
+    auto value = parseValue(FieldType(body[0]), body.size() - 1, argv[4]);
+    request.insert(request.end(), value.begin(), value.end());
+    status = connection.receive(connection.send(SET, request), body);
+    if (status != OK) fail(status);
+    printValue(body);
+  } else if (command == "fields" && argc == 3) {
+    auto id = connection.send(FIELDS, {});
+    Status status;
+    while ((status = connection.receive(id, body)) == MORE) {
+      if (body.size() < 7) fail(BAD_REQUEST);
+      uint16_t size;
+      memcpy(&size, body.data() + 5, sizeof(size));
+      printf("%-50.*s %-9s %u\n", int(body.size() - 7), body.data() + 7,
+             body[4] < std::size(typeNames) ? typeNames[body[4]] : "?", size);
+    }
+    if (status != OK) fail(status);
+  } else usage();
+}
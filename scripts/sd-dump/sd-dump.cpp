@@ -0,0 +1,242 @@
+/*
+  Host side of the sd::dump command: download files from the SD card of the scale over the USB serial port.
+
+    sd-dump <tty> <file> [output]     download a file, output defaults to the file name without directories
+    sd-dump <tty> --log [directory]   download the measurement log (LOG/INDEX.BIN, and LOG/00000001.BIN onwards until
+                                      a missing segment) to directory, by default the current one
+
+  Downloads resume from the size of an existing output file, so an interrupted run can simply be repeated, and
+  repeating it later fetches only what was appended in the meantime. Frames with a bad CRC or out of order make the
+  transfer restart from the first missing byte. Build with
+
+    g++ -std=gnu++17 -O2 scripts/sd-dump/sd-dump.cpp -o sd-dump
+*/
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace {
+
+// keep in sync with DumpFrame in src/main.cpp
+struct DumpFrame {
+  uint32_t offset;
+  uint16_t sequence, length;
+} __attribute__((packed));
+
+constexpr const size_t maxFrameData = 512;
+constexpr const int silenceTimeout = 3000, maxAttempts = 10;
+
+uint32_t crc32(const uint8_t *data, size_t length) {
+  uint32_t crc = ~0u;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1));
+  }
+  return ~crc;
+}
+
+bool cobsDecode(const std::vector<uint8_t> &src, std::vector<uint8_t> &dst) {
+  dst.clear();
+  for (size_t i = 0; i < src.size();) {
+    uint8_t code = src[i++];
+    if (!code || i + code - 1 > src.size()) return false;
+    dst.insert(dst.end(), src.begin() + i, src.begin() + i + code - 1);
+    i += code - 1;
+    if (code != 0xff && i < src.size()) dst.push_back(0);
+  }
+  return true;
+}
+
+double now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int openSerial(const char *path) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    perror(path);
+    exit(1);
+  }
+  termios tio;
+  if (tcgetattr(fd, &tio)) {
+    perror("tcgetattr");
+    exit(1);
+  }
+  cfmakeraw(&tio);
+  // the ESP32-S3 USB bridge applies this line coding to the UART of the RA4M1, it must match BLASTIC_MONITOR_SPEED
+  cfsetspeed(&tio, B115200);
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  tcsetattr(fd, TCSANOW, &tio);
+  tcflush(fd, TCIOFLUSH);
+  return fd;
+}
+
+enum class Result { DONE, MISSING, RETRY };
+
+/*
+  Run sd::dump once from offset, appending the received data to out.
+*/
+
+Result transfer(int fd, const char *file, FILE *out, uint32_t &offset) {
+  char command[256];
+  snprintf(command, sizeof(command), "sd::dump %s %u\n", file, offset);
+  if (write(fd, command, strlen(command)) < 0) {
+    perror("write");
+    exit(1);
+  }
+  std::vector<uint8_t> segment, payload;
+  std::string text;
+  bool inOrder = true;
+  uint8_t buffer[4096];
+  while (true) {
+    pollfd pfd{fd, POLLIN, 0};
+    if (poll(&pfd, 1, silenceTimeout) <= 0) {
+      fprintf(stderr, "%s: timeout at offset %u\n", file, offset);
+      return Result::RETRY;
+    }
+    auto n = read(fd, buffer, sizeof(buffer));
+    if (n <= 0) {
+      perror("read");
+      exit(1);
+    }
+    for (ssize_t i = 0; i < n; i++) {
+      if (buffer[i]) {
+        segment.push_back(buffer[i]);
+        continue;
+      }
+      if (segment.empty()) continue;
+      // a frame
+      if (cobsDecode(segment, payload) && payload.size() >= sizeof(DumpFrame) + sizeof(uint32_t)) {
+        DumpFrame header;
+        memcpy(&header, payload.data(), sizeof(header));
+        uint32_t crc;
+        memcpy(&crc, payload.data() + payload.size() - sizeof(crc), sizeof(crc));
+        if (header.length <= maxFrameData && payload.size() == sizeof(header) + header.length + sizeof(crc) &&
+            crc == crc32(payload.data(), payload.size() - sizeof(crc))) {
+          segment.clear();
+          if (!header.length) {
+            if (inOrder && header.offset == offset) return Result::DONE;
+            return Result::RETRY;
+          }
+          if (!inOrder || header.offset != offset) {
+            // a lost or corrupted frame, wait for the end of this transfer and restart from offset
+            if (inOrder) fprintf(stderr, "%s: missing data at offset %u\n", file, offset);
+            inOrder = false;
+            continue;
+          }
+          fwrite(payload.data() + sizeof(header), 1, header.length, out);
+          offset += header.length;
+          continue;
+        }
+      }
+      // text, or a damaged frame
+      text.append(segment.begin(), segment.end());
+      segment.clear();
+      for (size_t newline; (newline = text.find('\n')) != std::string::npos; text.erase(0, newline + 1)) {
+        auto line = text.substr(0, newline);
+        if (line.rfind("sd::dump: cannot open ", 0) == 0 && line != "sd::dump: cannot open SD card")
+          return Result::MISSING;
+        if (line.rfind("sd::dump: error", 0) == 0 || line == "sd::dump: cannot open SD card") {
+          fprintf(stderr, "%s\n", line.c_str());
+          return Result::RETRY;
+        }
+        if (line.rfind("sd::dump: usage", 0) == 0) {
+          fprintf(stderr, "%s: %s\n", file, line.c_str());
+          exit(1);
+        }
+        unsigned long size;
+        // the remote file was truncated, restart from scratch
+        if (sscanf(line.c_str(), "sd::dump: %*s %lu bytes", &size) == 1 && size < offset) {
+          offset = 0;
+          return Result::RETRY;
+        }
+        if (line.rfind("sd::dump: ", 0) == 0) fprintf(stderr, "%s\n", line.c_str());
+      }
+    }
+  }
+}
+
+bool download(int fd, const char *file, const std::string &output) {
+  auto out = fopen(output.c_str(), "ab");
+  if (!out) {
+    perror(output.c_str());
+    exit(1);
+  }
+  uint32_t offset = ftell(out), start = offset;
+  auto startTime = now();
+  // attempts without progress
+  for (int attempts = 0; attempts < maxAttempts;) {
+    auto previous = offset;
+    auto result = transfer(fd, file, out, offset);
+    fflush(out);
+    if (offset < previous) {
+      fclose(out);
+      out = fopen(output.c_str(), "wb");
+      start = 0;
+    }
+    if (result == Result::DONE) {
+      fclose(out);
+      auto seconds = now() - startTime;
+      fprintf(stderr, "%s: %u bytes, %u new, %.1f s, %.0f KiB/s\n", file, offset, offset - start, seconds,
+              (offset - start) / 1024. / seconds);
+      return true;
+    }
+    if (result == Result::MISSING) {
+      fclose(out);
+      if (!offset) unlink(output.c_str());
+      return false;
+    }
+    attempts = offset > previous ? 0 : attempts + 1;
+    // let the transfer in progress end before restarting
+    for (pollfd pfd{fd, POLLIN, 0}; poll(&pfd, 1, 500) > 0;) {
+      uint8_t discard[4096];
+      if (read(fd, discard, sizeof(discard)) <= 0) break;
+    }
+  }
+  fclose(out);
+  fprintf(stderr, "%s: giving up after %d attempts without progress\n", file, maxAttempts);
+  exit(1);
+}
+
+[[noreturn]] void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s <tty> <file> [output]\n       %s <tty> --log [directory]\n", argv0, argv0);
+  exit(2);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3 || argc > 4) usage(argv[0]);
+  auto fd = openSerial(argv[1]);
+  if (strcmp(argv[2], "--log")) {
+    auto file = argv[2], name = strrchr(file, '/');
+    if (!download(fd, file, argc == 4 ? argv[3] : name ? name + 1 : file)) {
+      fprintf(stderr, "%s: not found\n", file);
+      return 1;
+    }
+    return 0;
+  }
+  std::string directory = argc == 4 ? argv[3] : ".";
+  mkdir(directory.c_str(), 0777);
+  download(fd, "LOG/INDEX.BIN", directory + "/INDEX.BIN");
+  for (unsigned segment = 1;; segment++) {
+    char file[32];
+    snprintf(file, sizeof(file), "LOG/%08u.BIN", segment);
+    if (!download(fd, file, directory + "/" + (file + 4))) break;
+  }
+  return 0;
+}
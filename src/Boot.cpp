@@ -0,0 +1,101 @@
+#include <algorithm>
+#include "blastic.h"
+#include "Boot.h"
+
+namespace blastic {
+
+namespace boot {
+
+namespace {
+
+uint32_t times[size_t(Phase::count)];
+
+constexpr const EventBits_t allJobs = EventBits_t(Job::tare) | EventBits_t(Job::time) | EventBits_t(Job::storage) |
+                                      EventBits_t(Job::cmdboot);
+
+EventGroupHandle_t jobs() {
+  static StaticEventGroup_t jobsBuff;
+  static EventGroupHandle_t jobs = xEventGroupCreateStatic(&jobsBuff);
+  return jobs;
+}
+
+} // namespace
+
+void mark(Phase phase) {
+  auto &time = times[size_t(phase)];
+  if (!time) time = millis() ?: 1;
+}
+
+uint32_t time(Phase phase) { return times[size_t(phase)]; }
+
+void done(Job job) {
+  switch (job) {
+  case Job::tare: mark(Phase::tare); break;
+  case Job::time: mark(Phase::time); break;
+  case Job::storage: mark(Phase::storage); break;
+  case Job::cmdboot: mark(Phase::cmdboot); break;
+  }
+  if ((xEventGroupSetBits(jobs(), EventBits_t(job)) & allJobs) != allJobs) return;
+  taskENTER_CRITICAL();
+  bool first = !time(Phase::ready);
+  mark(Phase::ready);
+  taskEXIT_CRITICAL();
+  if (!first) return;
+  MSerial serial;
+  serial->print("boot: ready in ");
+  serial->print(time(Phase::ready));
+  serial->print(" ms\n");
+}
+
+bool wait(Job job, TickType_t timeout) {
+  return xEventGroupWaitBits(jobs(), EventBits_t(job), false, true, timeout) & EventBits_t(job);
+}
+
+Console console;
+
+size_t Console::write(const uint8_t *data, size_t size) {
+  if (redirected && xTaskGetCurrentTaskHandle() == redirectedTask) return redirected->write(data, size);
+  if (release()) return Serial.write(data, size);
+  auto room = std::min<size_t>(size, bufferSize - length);
+  memcpy(buffer + length, data, room);
+  length += room;
+  dropped += size - room;
+  return size;
+}
+
+bool Console::release() {
+  if (attached) return true;
+  if (!Serial) return false;
+  attached = true;
+  mark(Phase::host);
+  Serial.write(buffer, length);
+  if (dropped) {
+    Serial.print("boot: dropped ");
+    Serial.print(dropped);
+    Serial.print(" bytes of the boot log\n");
+  }
+  return true;
+}
+
+void Console::redirect(Print *output) {
+  redirected = output;
+  redirectedTask = xTaskGetCurrentTaskHandle();
+}
+
+void watchHost() {
+  if (console.release()) return;
+  constexpr const uint32_t pollMillis = 100;
+  static StaticTimer_t hostTimerBuff;
+  static TimerHandle_t hostTimer = xTimerCreateStatic(
+      "bootHost", pdMS_TO_TICKS(pollMillis), true, nullptr,
+      [](TimerHandle_t timer) {
+        MSerial lock(0);
+        if (lock.owns() && console.release()) xTimerStop(timer, 0);
+      },
+      &hostTimerBuff);
+  configASSERT(xTimerStart(hostTimer, portMAX_DELAY));
+}
+
+} // namespace boot
+
+} // namespace blastic
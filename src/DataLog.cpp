@@ -0,0 +1,240 @@
+#include <cstdio>
+#include <algorithm>
+#include "blastic.h"
+#include "DataLog.h"
+
+namespace blastic {
+
+namespace datalog {
+
+namespace {
+
+constexpr const char directory[] = "LOG";
+using SegmentPath = util::StringBuffer<sizeof("LOG/00000000.BIN")>;
+
+SegmentPath segmentPath(uint32_t segment) {
+  SegmentPath path;
+  // 8.3 file names
+  snprintf(path, sizeof(path), "%s/%08lu.BIN", directory, (unsigned long)(segment % 100000000));
+  return path;
+}
+
+constexpr const char indexPath[] = "LOG/INDEX.BIN";
+
+AppendFile segmentFile(""), indexFile(indexPath);
+
+// the last segment, valid for the mount generation
+struct {
+  uint32_t generation = 0, segment;
+  // the last segment is open in segmentFile, and header, records and lastEpoch are valid
+  bool open;
+  uint32_t records;
+  int32_t lastEpoch;
+  SegmentHeader header;
+} last;
+
+uint32_t segmentRecords(uint32_t size) {
+  return size > sizeof(SegmentHeader) ? (size - sizeof(SegmentHeader)) / sizeof(Record) : 0;
+}
+
+/*
+  Segments are numbered without gaps, so the last one is found with an exponential then a binary search on the file
+  names.
+*/
+
+bool scan(SDCard &sd) {
+  if (last.generation == SDCard::generation()) return true;
+  if (!sd->exists(directory) && !sd->mkdir(directory)) {
+    sd.failed();
+    return false;
+  }
+  uint32_t low = 0, high = 1;
+  for (; sd->exists(segmentPath(high)); high *= 2) low = high;
+  while (high - low > 1) {
+    auto middle = low + (high - low) / 2;
+    (sd->exists(segmentPath(middle)) ? low : high) = middle;
+  }
+  last.generation = SDCard::generation();
+  last.segment = low;
+  last.open = false;
+  return true;
+}
+
+bool startSegment(SDCard &sd, uint32_t segment) {
+  segmentFile.reopen(sd, segmentPath(segment));
+  auto file = segmentFile.open(sd);
+  if (!file || (file->size() && !segmentFile.truncate(0))) return false;
+  auto &header = last.header;
+  memset(&header, 0, sizeof(header));
+  header.signature = SegmentHeader::expectedSignature;
+  header.version = SegmentHeader::currentVersion;
+  header.recordSize = sizeof(Record);
+  header.createdEpoch = ntp::unixTime();
+  header.collectionPoint = config.submit.collectionPoint;
+  header.collectorName = config.submit.collectorName;
+  header.collector = collectorHash(header.collectionPoint, header.collectorName);
+  header.crc = header.checksum();
+  last.open = false;
+  if (!segmentFile.append(sd, &header, sizeof(header)) || !segmentFile.sync(sd)) return false;
+  last.segment = segment;
+  last.records = 0;
+  last.lastEpoch = 0;
+  last.open = true;
+  return true;
+}
+
+/*
+  Open the last segment, and truncate a torn record at its end. Only a record at the end can be torn, as records never
+  straddle a sector. A torn index entry is truncated too.
+*/
+
+bool openLast(SDCard &sd) {
+  if (!scan(sd)) return false;
+  if (last.open) return true;
+  if (auto index = indexFile.open(sd))
+    if (auto tornEntry = index->size() % sizeof(IndexEntry)) indexFile.truncate(index->size() - tornEntry);
+  if (!last.segment) return startSegment(sd, 1);
+  auto path = segmentPath(last.segment);
+  segmentFile.reopen(sd, path);
+  auto file = segmentFile.open(sd);
+  if (!file) return false;
+  auto size = file->size();
+  // a torn header: the segment has no records
+  if (size < sizeof(SegmentHeader)) return startSegment(sd, last.segment);
+  file->seek(0);
+  if (file->read(&last.header, sizeof(last.header)) != sizeof(last.header) || !last.header.valid()) {
+    MSerial serial;
+    serial->print("datalog: bad header in ");
+    serial->print(path);
+    serial->print(", starting a new segment\n");
+    return startSegment(sd, last.segment + 1);
+  }
+  // a partial record, and a complete record with a bad checksum
+  auto torn = (size - sizeof(SegmentHeader)) % sizeof(Record);
+  Record record;
+  last.lastEpoch = 0;
+  if (size - torn > sizeof(SegmentHeader)) {
+    file->seek(size - torn - sizeof(Record));
+    if (file->read(&record, sizeof(record)) != sizeof(record) || !record.valid()) torn += sizeof(Record);
+    else last.lastEpoch = record.epoch;
+  }
+  if (torn) {
+    if (!segmentFile.truncate(size -= torn)) return false;
+    MSerial serial;
+    serial->print("datalog: truncated ");
+    serial->print(torn);
+    serial->print(" bytes of a torn record in ");
+    serial->println(path);
+  }
+  last.records = segmentRecords(size);
+  last.open = true;
+  return true;
+}
+
+} // namespace
+
+uint32_t collectorHash(const char *collectionPoint, const char *collectorName) {
+  return util::crc32(collectorName, strlen(collectorName), util::crc32(collectionPoint, strlen(collectionPoint) + 1));
+}
+
+bool append(SDCard &sd, int32_t epoch, float weight, plastic type) {
+  if (!openLast(sd)) return false;
+  auto &submit = config.submit;
+  constexpr const int32_t day = 24 * 60 * 60;
+  if (last.records >= maxSegmentRecords || strcmp(last.header.collectionPoint, submit.collectionPoint) ||
+      strcmp(last.header.collectorName, submit.collectorName) ||
+      (epoch && last.lastEpoch && epoch / day != last.lastEpoch / day)) {
+    if (!startSegment(sd, last.segment + 1)) return false;
+  }
+  Record record{epoch, weight, type, uint8_t(epoch ? 0 : Record::TIME_UNSET), uint16_t(last.header.collector), 0};
+  record.crc = record.checksum();
+  if (!segmentFile.append(sd, &record, sizeof(record))) {
+    last.open = false;
+    return false;
+  }
+  // a missing index entry only makes searches scan more records
+  if (epoch && (!last.records || last.records % indexInterval == 0)) {
+    IndexEntry entry{epoch, {last.segment, last.records}};
+    indexFile.append(sd, &entry, sizeof(entry));
+  }
+  last.records++;
+  if (epoch) last.lastEpoch = epoch;
+  return true;
+}
+
+uint32_t lastSegment(SDCard &sd) { return scan(sd) ? last.segment : 0; }
+
+/*
+  Binary search of the last index entry older than from. Each step reads a single entry.
+*/
+
+Position find(SDCard &sd, int32_t from) {
+  Position position{1, 0};
+  if (!scan(sd)) return position;
+  if (last.open) indexFile.sync(sd);
+  auto file = sd->open(indexPath, O_READ);
+  if (!file) return position;
+  uint32_t low = 0, high = file.size() / sizeof(IndexEntry);
+  while (low < high) {
+    auto middle = low + (high - low) / 2;
+    IndexEntry entry;
+    file.seek(middle * sizeof(IndexEntry));
+    if (file.read(&entry, sizeof(entry)) != sizeof(entry)) break;
+    if (entry.epoch < from) {
+      position = entry.position;
+      low = middle + 1;
+    } else high = middle;
+  }
+  file.close();
+  return position;
+}
+
+Position tail(SDCard &sd, uint32_t n) {
+  if (!scan(sd) || !last.segment) return {1, 0};
+  if (last.open) segmentFile.sync(sd);
+  for (auto segment = last.segment;; segment--) {
+    auto file = sd->open(segmentPath(segment), O_READ);
+    auto count = file ? segmentRecords(file.size()) : 0;
+    file.close();
+    if (n <= count || segment == 1) return {segment, count > n ? count - n : 0};
+    n -= count;
+  }
+}
+
+int read(SDCard &sd, Position &position, Record *records, size_t max, SegmentHeader *header) {
+  if (!scan(sd)) return -1;
+  // records are read through another handle, which sees only what has been synced
+  if (last.open) segmentFile.sync(sd);
+  if (!position.segment) position = {1, 0};
+  for (; position.segment <= last.segment; position = {position.segment + 1, 0}) {
+    auto file = sd->open(segmentPath(position.segment), O_READ);
+    if (!file) {
+      sd.failed();
+      return -1;
+    }
+    SegmentHeader segmentHeader;
+    if (file.read(&segmentHeader, sizeof(segmentHeader)) != sizeof(segmentHeader) || !segmentHeader.valid()) {
+      file.close();
+      continue;
+    }
+    uint32_t count = (file.size() - sizeof(SegmentHeader)) / sizeof(Record);
+    if (position.record >= count) {
+      file.close();
+      if (position.segment == last.segment) return -1;
+      continue;
+    }
+    auto n = std::min<size_t>(max, count - position.record);
+    file.seek(sizeof(SegmentHeader) + position.record * sizeof(Record));
+    n = std::max(file.read(records, n * sizeof(Record)), 0) / sizeof(Record);
+    file.close();
+    if (!n) return -1;
+    position.record += n;
+    if (header) *header = segmentHeader;
+    return std::remove_if(records, records + n, [](const Record &record) { return !record.valid(); }) - records;
+  }
+  return -1;
+}
+
+} // namespace datalog
+
+} // namespace blastic
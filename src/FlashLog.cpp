@@ -0,0 +1,214 @@
+#include <algorithm>
+#include "DataFlashBlockDevice.h"
+#include "blastic.h"
+#include "FlashLog.h"
+#include "DataLog.h"
+#include "Stats.h"
+
+namespace blastic {
+
+namespace flashlog {
+
+namespace {
+
+// the ring state, scanned from the flash on first use, accessed with the DataFlash locked
+struct {
+  bool scanned = false;
+  // address of the first slot, slots per block, total slots
+  uint32_t first, blockSlots, slots;
+  // the next slot to program, and the next sequence number
+  uint32_t head, sequence;
+  // the last migrated sequence number, 0 if none
+  uint32_t migrated;
+  uint32_t pending, lost;
+} ring;
+
+bool readSlot(uint32_t slot, Record &record) {
+  return !DataFlashBlockDevice::getInstance().read(&record, ring.first + slot * sizeof(Record), sizeof(Record));
+}
+
+bool empty(const Record &record) { return record.sequence == UINT32_MAX; }
+
+bool isPending(const Record &record) {
+  return !empty(record) && record.valid() && !(record.flags & Record::MIGRATED) && record.sequence > ring.migrated;
+}
+
+// the oldest slot follows the block of head
+uint32_t oldest() { return (ring.head + ring.blockSlots - 1) / ring.blockSlots * ring.blockSlots % ring.slots; }
+
+/*
+  Find the record with the highest sequence number, head follows it, and the last migration record.
+*/
+
+bool scan() {
+  if (ring.scanned) return true;
+  auto &flash = DataFlashBlockDevice::getInstance();
+  ring.first = eeprom::configAreaSize();
+  ring.blockSlots = flash.get_erase_size() / sizeof(Record);
+  ring.slots = ring.first < FLASH_TOTAL_SIZE ? (FLASH_TOTAL_SIZE - ring.first) / sizeof(Record) : 0;
+  if (ring.slots < 2 * ring.blockSlots) {
+    MSerial()->print("flashlog: not enough DataFlash after the config\n");
+    return false;
+  }
+  ring.head = ring.migrated = ring.pending = ring.lost = 0;
+  ring.sequence = 1;
+  Record record;
+  for (uint32_t slot = 0; slot < ring.slots; slot++) {
+    if (!readSlot(slot, record)) return false;
+    if (empty(record) || !record.valid()) continue;
+    if (record.sequence >= ring.sequence) {
+      ring.sequence = record.sequence + 1;
+      ring.head = (slot + 1) % ring.slots;
+    }
+    if (record.flags & Record::MIGRATED) ring.migrated = std::max(ring.migrated, uint32_t(record.epoch));
+  }
+  for (uint32_t slot = 0; slot < ring.slots; slot++)
+    if (readSlot(slot, record) && isPending(record)) ring.pending++;
+  ring.scanned = true;
+  return true;
+}
+
+/*
+  Program a record at head, starting a new block if head is at the start of one: the block holds the oldest records,
+  which are counted as lost if not migrated, and it is erased unless already empty. A new block starts with a
+  migration record, so that the last one is never erased.
+*/
+
+bool program(Record record) {
+  auto &flash = DataFlashBlockDevice::getInstance();
+  Record slotRecord;
+  while (true) {
+    if (ring.head % ring.blockSlots == 0) {
+      bool dirty = false;
+      uint32_t lost = 0;
+      for (uint32_t slot = ring.head; slot < ring.head + ring.blockSlots; slot++) {
+        if (!readSlot(slot, slotRecord)) return false;
+        dirty = dirty || !empty(slotRecord);
+        if (isPending(slotRecord)) lost++;
+      }
+      if (dirty && flash.erase(ring.first + ring.head * sizeof(Record), ring.blockSlots * sizeof(Record))) return false;
+      if (lost) {
+        ring.pending -= lost;
+        ring.lost += lost;
+        MSerial serial;
+        serial->print("flashlog: overwrote ");
+        serial->print(lost);
+        serial->print(" records not migrated yet\n");
+      }
+      if (ring.migrated && !(record.flags & Record::MIGRATED)) {
+        Record migration{ring.sequence++, int32_t(ring.migrated), 0, {}, Record::MIGRATED, 0};
+        migration.crc = migration.checksum();
+        if (flash.program(&migration, ring.first + ring.head * sizeof(Record), sizeof(Record))) return false;
+        ring.head++;
+      }
+      break;
+    }
+    // skip slots with torn records
+    if (!readSlot(ring.head, slotRecord)) return false;
+    if (empty(slotRecord)) break;
+    ring.head = (ring.head + 1) % ring.slots;
+  }
+  record.sequence = ring.sequence++;
+  record.crc = record.checksum();
+  if (flash.program(&record, ring.first + ring.head * sizeof(Record), sizeof(Record))) return false;
+  ring.head = (ring.head + 1) % ring.slots;
+  return true;
+}
+
+} // namespace
+
+bool append(int32_t epoch, float weight, plastic type) {
+  MDataFlash lock;
+  if (!scan()) return false;
+  if (!program({0, epoch, weight, type, uint8_t(epoch ? 0 : Record::TIME_UNSET), 0})) {
+    // rescan on the next use
+    ring.scanned = false;
+    return false;
+  }
+  ring.pending++;
+  return true;
+}
+
+uint32_t pending() {
+  MDataFlash lock;
+  return scan() ? ring.pending : 0;
+}
+
+int migrate(SDCard &sd) {
+  MDataFlash lock;
+  if (!scan()) return -1;
+  auto &submit = config.submit;
+  int moved = 0;
+  bool failed = false;
+  auto migrated = ring.migrated;
+  Record record;
+  for (uint32_t i = 0, start = oldest(); i < ring.slots && ring.pending; i++) {
+    if (!readSlot((start + i) % ring.slots, record)) break;
+    if (!isPending(record)) continue;
+    auto epoch = record.flags & Record::TIME_UNSET ? 0 : record.epoch;
+    if (!datalog::append(sd, epoch, record.weight, record.type)) {
+      failed = true;
+      break;
+    }
+    stats::add(sd, epoch, record.weight, record.type, submit.collectionPoint, submit.collectorName);
+    migrated = record.sequence;
+    ring.pending--;
+    moved++;
+  }
+  if (moved) {
+    ring.migrated = migrated;
+    if (!program({0, int32_t(migrated), 0, {}, Record::MIGRATED, 0})) {
+      // the records will be migrated again
+      ring.scanned = false;
+      return -1;
+    }
+  }
+  return failed && !moved ? -1 : moved;
+}
+
+void migratePending(SDCard &sd) {
+  if (!pending()) return;
+  auto moved = migrate(sd);
+  MSerial serial;
+  if (moved < 0) serial->print("flashlog: could not move the flash log to the SD card\n");
+  else {
+    serial->print("flashlog: moved ");
+    serial->print(moved);
+    serial->print(" records from the flash log to the SD card\n");
+  }
+}
+
+Status status() {
+  MDataFlash lock;
+  if (!scan()) return {};
+  Status status{ring.slots / ring.blockSlots, ring.slots, 0, ring.pending, ring.lost};
+  Record record;
+  for (uint32_t slot = 0; slot < ring.slots; slot++)
+    if (readSlot(slot, record) && !empty(record) && record.valid() && !(record.flags & Record::MIGRATED))
+      status.records++;
+  return status;
+}
+
+int read(uint32_t &position, Record *records, size_t max) {
+  MDataFlash lock;
+  if (!scan() || position >= ring.slots) return -1;
+  size_t n = 0;
+  for (auto start = oldest(); position < ring.slots && n < max; position++) {
+    auto &record = records[n];
+    if (readSlot((start + position) % ring.slots, record) && !empty(record) && record.valid() &&
+        !(record.flags & Record::MIGRATED))
+      n++;
+  }
+  return n;
+}
+
+bool clear() {
+  MDataFlash lock;
+  if (!scan()) return false;
+  ring.scanned = false;
+  return !DataFlashBlockDevice::getInstance().erase(ring.first, ring.slots * sizeof(Record));
+}
+
+} // namespace flashlog
+
+} // namespace blastic
@@ -0,0 +1,298 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include "blastic.h"
+#include "Sinks.h"
+#include "SDCard.h"
+#include "DataLog.h"
+
+namespace blastic {
+
+namespace sinks {
+
+static constexpr const char dataFile[] = "data.csv", cursorFile[] = "replay.cur";
+
+/*
+  The cursor is stored as a fixed length text line, and it is always rewritten in place: a single sector write, that
+  either happens completely or not at all.
+*/
+
+static constexpr const char cursorFormat[] = "%010lu %010lu %010lu %011ld %011ld\n";
+static constexpr const size_t cursorLength = 10 + 1 + 10 + 1 + 10 + 1 + 11 + 1 + 11 + 1;
+
+// collectionPoint,collectorName,type,epoch,weight
+static constexpr const size_t maxRowLength = 2 * (sizeof(Submitter::Config<0>::collectionPoint) - 1) + 64;
+
+static bool loadCursor(Replay::Cursor &cursor) {
+  SDCard sd(config.sdcard.CSPin);
+  if (!sd) return false;
+  auto file = sd->open(cursorFile, O_READ);
+  if (!file) return false;
+  char line[cursorLength + 1]{};
+  file.read(line, cursorLength);
+  file.close();
+  unsigned long csvOffset, segment, record;
+  long lastEpoch, fromEpoch;
+  if (sscanf(line, "%lu %lu %lu %ld %ld", &csvOffset, &segment, &record, &lastEpoch, &fromEpoch) != 5) {
+    MSerial()->print("submit::replay: corrupted cursor file\n");
+    return false;
+  }
+  cursor = {uint32_t(csvOffset), {uint32_t(segment), uint32_t(record)}, int32_t(lastEpoch), int32_t(fromEpoch)};
+  return true;
+}
+
+bool Replay::saveCursor() {
+  SDCard sd(config.sdcard.CSPin);
+  if (!sd) return false;
+  auto file = sd->open(cursorFile, O_CREAT | O_WRITE);
+  if (!file) return false;
+  char line[cursorLength + 1];
+  snprintf(line, sizeof(line), cursorFormat, (unsigned long)cursor.csvOffset, (unsigned long)cursor.position.segment,
+           (unsigned long)cursor.position.record, (long)cursor.lastEpoch, (long)cursor.fromEpoch);
+  file.seek(0);
+  file.write(reinterpret_cast<const uint8_t *>(line), cursorLength);
+  file.close();
+  return !file.getWriteError();
+}
+
+void Replay::begin(int32_t fromEpoch) {
+  active = false;
+  cursor = {0, {0, 0}, 0, fromEpoch};
+  if (!saveCursor()) {
+    MSerial()->print("submit::replay: cannot write the cursor file\n");
+    return;
+  }
+  resume();
+}
+
+// the position of the cursor, in data.csv or in the log
+void Replay::printPosition(Print &p) const {
+  if (inCsv(cursor)) {
+    p.print("data.csv offset ");
+    p.print(cursor.csvOffset);
+    p.print('/');
+    p.print(csvSize);
+    return;
+  }
+  p.print("segment ");
+  p.print(cursor.position.segment);
+  p.print('/');
+  p.print(segments);
+  p.print(" record ");
+  p.print(cursor.position.record);
+}
+
+void Replay::resume() {
+  if (!loadCursor(cursor)) cursor = {0, {0, 0}, 0, 0};
+  {
+    SDCard sd(config.sdcard.CSPin);
+    if (!sd) {
+      MSerial()->print("submit::replay: cannot open SD card\n");
+      return;
+    }
+    segments = datalog::lastSegment(sd);
+    // data.csv is no longer written
+    auto file = sd->open(dataFile, O_READ);
+    csvSize = file ? file.size() : 0;
+    file.close();
+  }
+  if (cursor.position.segment > segments || (!cursor.position.segment && cursor.csvOffset > csvSize)) {
+    MSerial()->print("submit::replay: the log is shorter than the cursor, restarting after the last replayed epoch\n");
+    cursor = {0, {0, 0}, cursor.lastEpoch, std::max(cursor.fromEpoch, cursor.lastEpoch + 1)};
+  }
+  active = true;
+  rows = skipped = 0;
+  startMillis = millis();
+  MSerial serial;
+  serial->print("submit::replay: starting at ");
+  printPosition(*serial);
+  serial->print(", from epoch ");
+  serial->println(cursor.fromEpoch);
+}
+
+/*
+  Rows are parsed from the end, as collectionPoint and collectorName may contain commas. Rows that cannot be parsed
+  (such as the header) are skipped. The names are split at the current collection point if the row starts with it,
+  otherwise at the first comma.
+*/
+
+static bool parseRow(char *row, Measurement &measurement, const char *&collectionPoint, const char *&collectorName) {
+  auto field = [&row](char *&start) {
+    auto comma = strrchr(row, ',');
+    if (!comma) return false;
+    *comma = '\0';
+    start = comma + 1;
+    return true;
+  };
+  char *weight, *epoch, *type, *end;
+  if (!field(weight) || !field(epoch) || !field(type)) return false;
+  measurement.weight = strtof(weight, &end);
+  if (end == weight || !isfinite(measurement.weight)) return false;
+  measurement.epoch = strtol(epoch, &end, 10);
+  if (end == epoch) return false;
+  auto current = strlen(config.submit.collectionPoint);
+  auto comma = !strncmp(row, config.submit.collectionPoint, current) && row[current] == ',' ? row + current
+                                                                                            : strchr(row, ',');
+  if (!comma) return false;
+  *comma = '\0';
+  collectionPoint = row;
+  collectorName = comma + 1;
+  for (auto p : plastics)
+    if (!strcmp(type, plasticName(p))) {
+      measurement.type = p;
+      return true;
+    }
+  return false;
+}
+
+size_t Replay::read(Measurement *batch, size_t max) {
+  SDCard sd(config.sdcard.CSPin);
+  if (!sd) {
+    end("cannot open SD card");
+    return 0;
+  }
+  next = cursor;
+  pending = 0;
+  if (inCsv(next)) {
+    if (readCsv(sd, batch, max) || inCsv(next)) return pending;
+    // past the end of data.csv, continue with the log
+    next.position = {1, 0};
+    cursor = next;
+    saveCursor();
+  }
+  return readLog(sd, batch, max);
+}
+
+size_t Replay::readCsv(SDCard &sd, Measurement *batch, size_t max) {
+  auto file = sd->open(dataFile, O_READ);
+  if (!file || !file.seek(next.csvOffset)) {
+    end("cannot read data.csv");
+    return 0;
+  }
+  // bound the rows scanned while holding the SD card, in case many are skipped
+  bool eof = false;
+  char row[maxRowLength + 1];
+  for (size_t scanned = 0; pending < max && scanned < 8 * max; scanned++) {
+    auto length = file.read(row, maxRowLength);
+    auto newline = length > 0 ? static_cast<char *>(memchr(row, '\n', length)) : nullptr;
+    if (!newline) {
+      if (length < int(maxRowLength)) {
+        eof = true;
+        break;
+      }
+      // overlong garbage, skip it
+      next.csvOffset += length;
+      skipped++;
+      continue;
+    }
+    *newline = '\0';
+    if (newline > row && newline[-1] == '\r') newline[-1] = '\0';
+    auto rowLength = newline - row + 1;
+    Measurement measurement;
+    const char *rowCollectionPoint, *rowCollectorName;
+    if (!parseRow(row, measurement, rowCollectionPoint, rowCollectorName)) skipped++;
+    else if (measurement.epoch >= next.fromEpoch) {
+      // the chunk is submitted under the names of its first row, leave the rows with other names to the next one
+      if (!pending) {
+        collectionPoint = rowCollectionPoint;
+        collectorName = rowCollectorName;
+      } else if (strcmp(rowCollectionPoint, collectionPoint) || strcmp(rowCollectorName, collectorName)) break;
+      batch[pending++] = measurement;
+      next.lastEpoch = measurement.epoch;
+    }
+    next.csvOffset += rowLength;
+    file.seek(next.csvOffset);
+  }
+  file.close();
+  // an incomplete last row is skipped
+  if (eof && !pending) next.csvOffset = csvSize;
+  if (!pending) {
+    // nothing to submit, but save the progress over the skipped rows
+    cursor = next;
+    saveCursor();
+  }
+  return pending;
+}
+
+size_t Replay::readLog(SDCard &sd, Measurement *batch, size_t max) {
+  segments = datalog::lastSegment(sd);
+  // bound the records read while holding the SD card, in case many are skipped
+  datalog::Record records[maxBatch];
+  for (size_t scanned = 0; pending < max && scanned < 8 * max;) {
+    auto previous = next.position;
+    datalog::SegmentHeader header;
+    auto n = datalog::read(sd, next.position, records, std::min(max - pending, std::size(records)), &header);
+    // the chunk is submitted under the names of its first record, leave the records with other names to the next one
+    if (n > 0 && pending &&
+        (strcmp(header.collectionPoint, collectionPoint) || strcmp(header.collectorName, collectorName))) {
+      next.position = previous;
+      break;
+    }
+    if (n < 0) {
+      if (!pending) {
+        // nothing to submit, but save the progress over the skipped records
+        cursor = next;
+        saveCursor();
+        end("done");
+      }
+      return pending;
+    }
+    // records with a bad checksum are skipped by datalog::read()
+    auto readRecords = next.position.record - (next.position.segment == previous.segment ? previous.record : 0);
+    scanned += readRecords;
+    skipped += readRecords - n;
+    for (int i = 0; i < n; i++) {
+      auto &record = records[i];
+      if (record.epoch < next.fromEpoch) continue;
+      if (!pending) {
+        collectionPoint = header.collectionPoint;
+        collectorName = header.collectorName;
+      }
+      batch[pending++] = {record.epoch, record.weight, record.type};
+      next.lastEpoch = record.epoch;
+    }
+  }
+  if (!pending) {
+    cursor = next;
+    saveCursor();
+  }
+  return pending;
+}
+
+void Replay::commit() {
+  cursor = next;
+  rows += pending;
+  if (!saveCursor()) {
+    end("cannot write the cursor file");
+    return;
+  }
+  auto elapsed = millis() - startMillis;
+  MSerial serial;
+  serial->print("submit::replay: ");
+  serial->print(rows);
+  serial->print(" rows, ");
+  printPosition(*serial);
+  serial->print(", ");
+  serial->print(elapsed ? rows * 1000.f / elapsed : 0.f, 2);
+  serial->print(" rows/s\n");
+}
+
+void Replay::end(const char *reason) {
+  if (!active) return;
+  active = false;
+  MSerial serial;
+  serial->print("submit::replay: ");
+  serial->print(reason);
+  serial->print(", ");
+  serial->print(rows);
+  serial->print(" rows submitted, ");
+  serial->print(skipped);
+  serial->print(" skipped, ");
+  auto elapsed = millis() - startMillis;
+  serial->print(elapsed ? rows * 1000.f / elapsed : 0.f, 2);
+  serial->print(" rows/s\n");
+}
+
+} // namespace sinks
+
+} // namespace blastic
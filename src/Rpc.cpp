@@ -0,0 +1,165 @@
+#include "blastic.h"
+#include "Rpc.h"
+#include "ConfigSchema.h"
+#include "Sinks.h"
+
+namespace cli {
+
+namespace rpc {
+
+namespace {
+
+using namespace blastic;
+using eeprom::schema::Field;
+
+constexpr const size_t maxResponseBody = 256;
+static_assert(1 + eeprom::schema::maxFieldSize() <= maxResponseBody);
+
+/*
+  Only accessed by the CLI task. The request is received encoded, then decoded in place; overflow is set when more
+  bytes arrived than it holds, and the frame is discarded at its end.
+*/
+uint8_t request[util::cobsEncodedSize(sizeof(Header) + maxRequestBody + sizeof(uint32_t))];
+size_t requestLength;
+bool overflow;
+
+void respond(Print &output, const Header &request, Status status, const void *body = nullptr, size_t length = 0) {
+  static uint8_t payload[sizeof(Header) + maxResponseBody + sizeof(uint32_t)];
+  static uint8_t frame[util::cobsEncodedSize(sizeof(payload)) + 2];
+  Header header{request.id, request.type, status};
+  memcpy(payload, &header, sizeof(header));
+  if (length) memcpy(payload + sizeof(header), body, length);
+  length += sizeof(header);
+  auto crc = util::crc32(payload, length);
+  memcpy(payload + length, &crc, sizeof(crc));
+  frame[0] = 0;
+  auto encoded = util::cobsEncode(payload, length + sizeof(crc), frame + 1);
+  frame[encoded + 1] = 0;
+  output.write(frame, encoded + 2);
+}
+
+/*
+  The text output of a CALL command, sent in MORE frames at each line end, and when a frame body is full. The frames are
+  written straight to Serial, as the console redirects the output of the CLI task here.
+*/
+
+class CallOutput : public Print {
+  const Header &request;
+  uint8_t body[maxResponseBody];
+  size_t length = 0;
+
+public:
+  CallOutput(const Header &request) : request(request) {}
+
+  using Print::write;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *data, size_t size) override {
+    for (size_t i = 0; i < size; i++) {
+      body[length++] = data[i];
+      if (length == sizeof(body) || data[i] == '\n') flush();
+    }
+    return size;
+  }
+  void flush() override {
+    if (!length) return;
+    respond(Serial, request, MORE, body, length);
+    length = 0;
+  }
+};
+
+// the type and the value of the field
+void respondField(Print &output, const Header &request, const Field &field) {
+  uint8_t body[1 + eeprom::schema::maxFieldSize()];
+  body[0] = uint8_t(field.type);
+  memcpy(body + 1, field.in(config), field.size);
+  respond(output, request, OK, body, 1 + field.size);
+}
+
+} // namespace
+
+void receive(uint8_t c) {
+  if (requestLength == sizeof(request)) overflow = true;
+  else request[requestLength++] = c;
+}
+
+void handle(CliLookup lookup, util::MutexedGenerator<Print> outputMutexGen) {
+  auto length = overflow ? -1 : util::cobsDecode(request, requestLength, request);
+  requestLength = 0;
+  overflow = false;
+  // an empty frame can be sent to resynchronize
+  if (!length) return;
+  if (length < int(sizeof(Header) + sizeof(uint32_t))) {
+    outputMutexGen.lock()->print("cli: discarding invalid or oversized rpc frame\n");
+    return;
+  }
+  length -= sizeof(uint32_t);
+  uint32_t crc;
+  memcpy(&crc, request + length, sizeof(crc));
+  if (crc != util::crc32(request, length)) {
+    outputMutexGen.lock()->print("cli: discarding rpc frame with a bad crc\n");
+    return;
+  }
+  Header header;
+  memcpy(&header, request, sizeof(header));
+  auto body = request + sizeof(header);
+  size_t bodyLength = length - sizeof(header);
+  switch (header.type) {
+  case CALL: {
+    // terminate over the crc
+    body[bodyLength] = '\0';
+    WordSplit commandLine(reinterpret_cast<char *>(body));
+    auto command = commandLine.nextWord();
+    auto callback = command ? lookup(util::murmur3_32(command)) : nullptr;
+    if (!callback) return respond(*outputMutexGen.lock(), header, NOT_FOUND);
+    // the command may take the WiFi or SD locks, which are always taken before the serial one: do not hold it
+    CallOutput output(header);
+    {
+      auto lock = outputMutexGen.lock();
+      boot::console.redirect(&output);
+    }
+    callback->function(commandLine);
+    auto lock = outputMutexGen.lock();
+    boot::console.redirect(nullptr);
+    output.flush();
+    return respond(*lock, header, OK);
+  }
+  case GET:
+  case SET: {
+    uint32_t nameHash;
+    if (bodyLength < sizeof(nameHash)) return respond(*outputMutexGen.lock(), header, BAD_REQUEST);
+    memcpy(&nameHash, body, sizeof(nameHash));
+    auto field = eeprom::schema::find(nameHash);
+    if (!field) return respond(*outputMutexGen.lock(), header, NOT_FOUND);
+    if (header.type == SET) {
+      if (bodyLength != sizeof(nameHash) + field->size) return respond(*outputMutexGen.lock(), header, BAD_REQUEST);
+      alignas(uint32_t) uint8_t value[eeprom::schema::maxFieldSize()];
+      memcpy(value, body + sizeof(nameHash), field->size);
+      if (!eeprom::schema::validate(*field, value)) return respond(*outputMutexGen.lock(), header, INVALID);
+      memcpy(field->in(config), value, field->size);
+      if (field->flags & Field::NOTIFY) sinks::configChanged();
+    }
+    return respondField(*outputMutexGen.lock(), header, *field);
+  }
+  case FIELDS: {
+    auto output = outputMutexGen.lock();
+    for (auto &field : eeprom::schema::fields) {
+      struct __attribute__((packed)) {
+        uint32_t nameHash;
+        uint8_t type;
+        uint16_t size;
+        char name[maxResponseBody - 7];
+      } entry{field.nameHash, uint8_t(field.type), field.size};
+      auto nameLength = std::min(strlen(field.name), sizeof(entry.name));
+      memcpy(entry.name, field.name, nameLength);
+      respond(*output, header, MORE, &entry, sizeof(entry) - sizeof(entry.name) + nameLength);
+    }
+    respond(*output, header, OK);
+    return;
+  }
+  default: respond(*outputMutexGen.lock(), header, UNKNOWN_TYPE);
+  }
+}
+
+} // namespace rpc
+
+} // namespace cli
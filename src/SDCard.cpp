@@ -0,0 +1,153 @@
+#include "blastic.h"
+#include "SDCard.h"
+#include "StaticTask.h"
+
+namespace blastic {
+
+namespace {
+
+bool mounted = false, remount = false;
+uint8_t mountedCSPin;
+uint32_t mountGeneration = 0;
+cid_t mountedCID;
+
+/*
+  Runs the time based syncs of AppendFile, queued by their timers.
+*/
+
+class SyncTask {
+  static constexpr const size_t queueLength = 4;
+  StaticQueue_t queueBuff;
+  uint8_t queueObjectsBuff[queueLength * sizeof(AppendFile *)];
+  const QueueHandle_t queue;
+  util::StaticTask<2 * 1024> task;
+
+  static void loop(void *_this) [[noreturn]] {
+    auto queue = static_cast<SyncTask *>(_this)->queue;
+    while (true) {
+      AppendFile *file;
+      if (!xQueueReceive(queue, &file, portMAX_DELAY)) continue;
+      SDCard sd(config.sdcard.CSPin);
+      if (sd && !file->sync(sd)) MSerial()->print("sdcard: timed sync failed\n");
+    }
+  }
+
+public:
+  SyncTask()
+      : queue(xQueueCreateStatic(queueLength, sizeof(AppendFile *), queueObjectsBuff, &queueBuff)),
+        task(SyncTask::loop, this, "AppendFileSync", tskIDLE_PRIORITY + 1) {}
+
+  bool request(AppendFile *file) { return xQueueSend(queue, &file, 0); }
+};
+
+SyncTask &syncTask() {
+  static SyncTask syncTask;
+  return syncTask;
+}
+
+} // namespace
+
+bool SDCard::mount(uint8_t CSPin) {
+  auto &card = SD.*get(util::SDClassBackdoor());
+  if (mounted && !remount && CSPin == mountedCSPin) {
+    cid_t cid;
+    if (card.readCID(&cid) && !memcmp(&cid, &mountedCID, sizeof(cid))) return true;
+    if (debug) MSerial()->print("sdcard: card removed or replaced, mounting again\n");
+  }
+  if (mounted) SD.end();
+  remount = false;
+  mounted = SD.begin(CSPin) && card.readCID(&mountedCID);
+  if (!mounted) return false;
+  mountedCSPin = CSPin;
+  mountGeneration++;
+  if (debug) MSerial()->print("sdcard: mounted\n");
+  return true;
+}
+
+void SDCard::failed() { remount = true; }
+
+uint32_t SDCard::generation() { return mountGeneration; }
+
+AppendFile::AppendFile(const char *path, void (*header)(Print &))
+    : header(header),
+      syncTimer(xTimerCreateStatic("SDsync", 1, false, this, AppendFile::syncTimerCallback, &syncTimerBuff)) {
+  this->path = path;
+  // create the task before the timer can fire
+  syncTask();
+}
+
+void AppendFile::close(SDCard &sd) {
+  if (!file) return;
+  if (openGeneration == SDCard::generation()) {
+    sync(sd);
+    file.close();
+    return;
+  }
+  // opened on an older mount: release the handle without touching the card
+  auto &handle = file.*get(util::FileBackdoor());
+  free(handle);
+  handle = nullptr;
+}
+
+File *AppendFile::open(SDCard &sd) {
+  if (file && openGeneration == SDCard::generation()) return &file;
+  close(sd);
+  unsynced = 0;
+  file = sd->open(path, O_CREAT | O_APPEND | O_RDWR);
+  if (!file) {
+    sd.failed();
+    return nullptr;
+  }
+  openGeneration = SDCard::generation();
+  if (!file.size() && header) {
+    header(file);
+    file.flush();
+  }
+  return &file;
+}
+
+bool AppendFile::append(SDCard &sd, const void *record, size_t length) {
+  if (!open(sd)) return false;
+  if (file.write(static_cast<const uint8_t *>(record), length) != length) {
+    file.clearWriteError();
+    sd.failed();
+    return false;
+  }
+  auto &policy = config.sdcard;
+  if (++unsynced >= policy.syncRecords) return sync(sd);
+  if (unsynced == 1 && policy.syncSeconds)
+    configASSERT(xTimerChangePeriod(syncTimer, pdMS_TO_TICKS(policy.syncSeconds * 1000), portMAX_DELAY));
+  return true;
+}
+
+void AppendFile::reopen(SDCard &sd, const char *path) {
+  close(sd);
+  this->path = path;
+}
+
+bool AppendFile::truncate(uint32_t size) {
+  if (!file || openGeneration != SDCard::generation()) return false;
+  unsynced = 0;
+  auto handle = file.*get(util::FileBackdoor());
+  return handle->truncate(size) && handle->sync();
+}
+
+bool AppendFile::sync(SDCard &sd) {
+  // the timer is harmless if it fires with nothing to sync
+  xTimerStop(syncTimer, 0);
+  if (!unsynced) return true;
+  unsynced = 0;
+  if (!file || openGeneration != SDCard::generation()) return false;
+  // File::flush() drops the result
+  if ((file.*get(util::FileBackdoor()))->sync()) return true;
+  sd.failed();
+  return false;
+}
+
+void AppendFile::syncTimerCallback(TimerHandle_t timer) {
+  // the timer task must not wait for the card lock nor write to the card: the sync task does, retry if it is busy
+  if (!syncTask().request(static_cast<AppendFile *>(pvTimerGetTimerID(timer))))
+    xTimerChangePeriod(timer, pdMS_TO_TICKS(100), 0);
+}
+
+} // namespace blastic
@@ -1,5 +1,10 @@
 #include "blastic.h"
 #include "SerialCliTask.h"
+#include "FlashLog.h"
+#include "Boot.h"
+#include "Rpc.h"
+
+ClassPrivateMemberAccessor(UART, sci_uart_instance_ctrl_t, uart_ctrl);
 
 namespace cli {
 
@@ -8,13 +13,72 @@ namespace details {
 // task delay in poll loop, milliseconds
 static constexpr const uint32_t pollInterval = 250;
 
+// set by notifyOnInput(), then read in the receive interrupt
+static TaskHandle_t inputTask;
+static void (*uartCallback)(uart_callback_args_t *);
+
+/*
+  Chained in front of the Arduino UART callback, which stores the character in the receive buffer. A line longer than
+  the CLI buffer also wakes the task, to report the overflow.
+*/
+static void notifyingCallback(uart_callback_args_t *args) {
+  constexpr const uint32_t maxUnnotified = 128;
+  static uint32_t unnotified = 0;
+  uartCallback(args);
+  if (args->event != UART_EVENT_RX_CHAR) return;
+  if (args->data != '\n' && args->data != '\0' && ++unnotified < maxUnnotified) return;
+  unnotified = 0;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(inputTask, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+void notifyOnInput(UART &uart) {
+  auto &ctrl = uart.*get(util::UARTBackdoor());
+  if (!ctrl.p_callback || inputTask) return;
+  uartCallback = ctrl.p_callback;
+  inputTask = xTaskGetCurrentTaskHandle();
+  if (R_SCI_UART_CallbackSet(&ctrl, notifyingCallback, ctrl.p_context, nullptr) != FSP_SUCCESS) inputTask = nullptr;
+}
+
+// only accessed by the CLI task
+static LineCapture capture;
+static bool inFrame;
+
+/*
+  Read the text of the serial input into dst, and pass the bytes of RPC frames to rpc::receive. A zero byte ends the
+  current line and starts a frame, the next one ends the frame: the read stops there with frame set, to handle it after
+  the text before it.
+*/
+static size_t readText(Stream &input, char *dst, size_t max, bool &frame) {
+  size_t len = 0;
+  while (!frame && (inFrame || len < max)) {
+    auto c = input.read();
+    if (c < 0) break;
+    if (inFrame) {
+      if (c) rpc::receive(c);
+      else frame = true, inFrame = false;
+    } else if (c) dst[len++] = c;
+    else {
+      dst[len++] = '\n';
+      inFrame = true;
+    }
+  }
+  return len;
+}
+
 void consumeAutostartFiles(const SerialCliTaskState &_this, util::MutexedGenerator<Print> outputMutexGen) {
   using namespace blastic;
   SDCard sd(config.sdcard.CSPin);
   if (!sd) {
     outputMutexGen.lock()->print("cli: cannot initialize SD card to read autostart files\n");
+    boot::done(boot::Job::storage);
+    boot::done(boot::Job::cmdboot);
     return;
   }
+  // the card may have been inserted while powered off
+  flashlog::migratePending(sd);
+  boot::done(boot::Job::storage);
   auto autostart = sd->open("cmdboot");
   if (autostart) {
     outputMutexGen.lock()->print("cli: found cmdboot file, now executing commands\n");
@@ -28,6 +92,7 @@ void consumeAutostartFiles(const SerialCliTaskState &_this, util::MutexedGenerat
     autostartOnce.close();
     sd->remove("cmdonce");
   }
+  boot::done(boot::Job::cmdboot);
 }
 
 void loop(const SerialCliTaskState &_this, Stream &input, util::MutexedGenerator<Print> outputMutexGen, bool loop) {
@@ -45,12 +110,14 @@ void loop(const SerialCliTaskState &_this, Stream &input, util::MutexedGenerator
   bool keepreading = true;
   while (keepreading) {
     auto oldLen = len;
+    bool frame = false;
     // this is non blocking with the serial interface as we used setTimeout(0) on initialization
-    len += input.readBytes(inputBuffer + len, maxLen - len);
-    if (oldLen == len) {
+    if (loop) len += readText(input, inputBuffer + len, maxLen - len, frame);
+    else len += input.readBytes(inputBuffer + len, maxLen - len);
+    if (oldLen == len && !frame) {
       if (!loop) keepreading = false;
       else {
-        vTaskDelay(pdMS_TO_TICKS(pollInterval));
+        ulTaskNotifyTake(pdTRUE, inputTask ? portMAX_DELAY : pdMS_TO_TICKS(pollInterval));
         continue;
       }
     }
@@ -83,16 +150,22 @@ void loop(const SerialCliTaskState &_this, Stream &input, util::MutexedGenerator
       }
       *dst = '\0';
       WordSplit commandLine(inputBuffer);
-      auto command = commandLine.nextWord();
+      char *command;
       uint32_t commandHash;
+      if (capture) {
+        auto current = capture;
+        // the capture may have started another one
+        if (!current(&commandLine) && capture == current) capture = nullptr;
+        goto shiftLeftBuffer;
+      }
+      command = commandLine.nextWord();
       // skip if line is empty
       if (!command || !*command) goto shiftLeftBuffer;
       commandHash = util::murmur3_32(command);
-      for (auto callback = _this.callbacks; callback->function; callback++)
-        if (callback->cliCommandHash == commandHash) {
-          callback->function(commandLine);
-          goto shiftLeftBuffer;
-        }
+      if (auto callback = _this.lookup(commandHash)) {
+        callback->function(commandLine);
+        goto shiftLeftBuffer;
+      }
       {
         auto output = outputMutexGen.lock();
         output->print("cli: command not found: ");
@@ -109,9 +182,21 @@ void loop(const SerialCliTaskState &_this, Stream &input, util::MutexedGenerator
       memmove(inputBuffer, nextLine, leftoverLen);
       len = leftoverLen;
     }
+    if (frame) rpc::handle(_this.lookup, outputMutexGen);
+  }
+  if (!loop && capture) {
+    outputMutexGen.lock()->print("cli: input ended before the end of a multi-line command\n");
+    capture(nullptr);
+    capture = nullptr;
   }
 }
 
 } // namespace details
 
+void captureLines(LineCapture capture) {
+  // abort a capture in progress
+  if (details::capture) details::capture(nullptr);
+  details::capture = capture;
+}
+
 } // namespace cli
@@ -0,0 +1,741 @@
+#include <memory>
+#include <algorithm>
+#include "blastic.h"
+#include "Sinks.h"
+#include <ArduinoHttpClient.h>
+#include <ArduinoMqttClient.h>
+#include "utils.h"
+#include "SDCard.h"
+#include "netstats.h"
+
+namespace blastic {
+
+namespace sinks {
+
+static constexpr const char userAgent[] = "blastic-scale/" BLASTIC_GIT_COMMIT " (" BLASTIC_GIT_WORKTREE_STATUS ")";
+
+static const Submitter::FormParameters blasticForm = []() {
+  Submitter::FormParameters form;
+  form.urn = "docs.google.com/forms/u/0/d/e/1FAIpQLSfmg2pnik2W7wLmmNigjfs4kgNBimxYe5ocRIpuLppBBE35fg/formResponse";
+  form.type = "entry.485899545";
+  form.collectionPoint = "entry.1447667805";
+  form.collectorName = "entry.436217948";
+  form.weight = "entry.1288178639";
+  return form;
+}();
+
+// ♳♴♵♶♷♸♹
+static constexpr const char *const unicodePlasticSymbols[] = {"%E2%99%B3", "%E2%99%B4", "%E2%99%B5", "%E2%99%B6",
+                                                              "%E2%99%B7", "%E2%99%B8", "%E2%99%B9"};
+
+/*
+  The form body is built in a static buffer (only the Dispatcher task uploads), sized for the worst case: all parameter
+  names at their maximum length, both user strings made only of characters that need percent encoding, and the longest
+  float that dtostrf() can print with two decimals.
+*/
+
+using EncodedParam = util::StringBuffer<util::urlEncodedSize(sizeof(Submitter::Config<0>::collectionPoint))>;
+static_assert(sizeof(Submitter::Config<0>::collectionPoint) == sizeof(Submitter::Config<0>::collectorName));
+static_assert(sizeof(userAgent) <= sizeof(Submitter::Config<0>::collectorName));
+static EncodedParam encodedCollectionPoint, encodedCollectorName;
+
+// sign, 39 integer digits, decimal point, 2 decimals
+static constexpr const size_t maxFloatLength = 1 + 39 + 1 + 2;
+static constexpr const size_t maxFormBodyLength =
+    4 * (sizeof(Submitter::FormParameters::Param) - 1) + 4 /* = */ + 3 /* & */ +
+    util::strlen(unicodePlasticSymbols[0]) + 1 /* + */ + util::strlen(plasticName(plastic::other)) +
+    2 * (sizeof(EncodedParam) - 1) + maxFloatLength;
+static util::StringBuilder<maxFormBodyLength + 1> formBody;
+
+void configChanged() {
+  auto &config = blastic::config.submit;
+  util::urlEncode(encodedCollectionPoint, sizeof(encodedCollectionPoint), config.collectionPoint);
+  util::urlEncode(encodedCollectorName, sizeof(encodedCollectorName),
+                  std::strlen(config.collectorName) ? config.collectorName : userAgent);
+}
+
+namespace {
+
+using namespace wifi;
+
+// split an urn in the form host/path
+struct Urn {
+  util::StringBuffer<64> host;
+  const char *path;
+
+  Urn(const char *urn) {
+    path = strchr(urn, '/');
+    if (path) host.strncpy(urn, path - urn);
+    else {
+      host = urn;
+      path = "/";
+    }
+  }
+};
+
+/*
+  Resolve and connect, recording the network phases. Resolution is done separately to measure it, the WiFi module
+  caches the result for the actual connection.
+*/
+
+bool resolve(const char *host, netstats::Stopwatch &stopwatch) {
+  IPAddress ip;
+  if (!MWiFi()->hostByName(host, ip)) {
+    MSerial serial;
+    serial->print("sinks: failed to resolve ");
+    serial->println(host);
+    return false;
+  }
+  stopwatch.lap(netstats::Phase::dns);
+  return true;
+}
+
+bool connect(SSLClient &tls, const char *host, uint16_t port, netstats::Stopwatch &stopwatch) {
+  if (!resolve(host, stopwatch)) return false;
+  if (!tls.connect(host, port)) {
+    MSerial serial;
+    serial->print("sinks: failed to connect to ");
+    serial->println(host);
+    return false;
+  }
+  stopwatch.lap(netstats::Phase::tlsConnect);
+  return true;
+}
+
+/*
+  If the clock needs a sync, look for the Date header. Headers usually arrive together with the status line, so the
+  wait for further data is short.
+*/
+
+void syncFromDateHeader(HttpClient &https) {
+  if (!ntp::stale()) return;
+  constexpr const uint32_t timeout = 1000;
+  util::StringBuilder<64> line;
+  for (auto start = millis(); !https.endOfHeadersReached() && millis() - start < timeout;) {
+    if (!https.available()) {
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+    auto c = char(https.readHeader());
+    if (c == '\r') continue;
+    if (c != '\n') {
+      line += c;
+      continue;
+    }
+    if (!strncasecmp(line, "date:", 5)) {
+      if (!ntp::syncFromHttpDate(line.data() + 5)) MSerial()->print("sinks: cannot parse http date\n");
+      return;
+    }
+    line.clear();
+  }
+}
+
+/*
+  POST a body of known length, written by writeBody(Print &), and return the HTTP status code.
+*/
+
+template <typename BodyWriter>
+Result post(const Urn &urn, const char *contentType, size_t contentLength, const char *token, BodyWriter &&writeBody) {
+  netstats::Stopwatch stopwatch;
+  SSLClient tls;
+  if (!connect(tls, urn.host, HttpClient::kHttpsPort, stopwatch)) return {State::ERROR, 0};
+  auto https = std::make_unique<HttpClient>(tls, urn.host, HttpClient::kHttpsPort);
+  https->beginRequest();
+  https->noDefaultRequestHeaders();
+  https->connectionKeepAlive();
+  https->post(urn.path);
+  https->sendHeader("Host", urn.host);
+  https->sendHeader("User-Agent", userAgent);
+  https->sendHeader("Content-Type", contentType);
+  https->sendHeader("Content-Length", contentLength);
+  if (token && std::strlen(token)) {
+    util::StringBuilder<sizeof(Submitter::JsonParameters::token) + 7> authorization;
+    authorization += "Bearer ";
+    authorization += token;
+    https->sendHeader("Authorization", authorization);
+  }
+  https->sendHeader("Accept", "*/*");
+  https->beginBody();
+  writeBody(*https);
+  https->endRequest();
+  stopwatch.lap(netstats::Phase::request);
+
+  auto code = https->responseStatusCode();
+  stopwatch.lap(netstats::Phase::response);
+  if (code >= 0) syncFromDateHeader(*https);
+  if (debug || code < 200 || code >= 300) {
+    MSerial serial;
+    serial->print("sinks: http status ");
+    serial->println(code);
+  }
+  if (code < 0) return {State::ERROR, code};
+  return {code >= 200 && code < 300 ? State::OK : State::REJECTED, code};
+}
+
+/*
+  Google Forms style application/x-www-form-urlencoded POST, one request per measurement.
+*/
+
+class FormSink : public Sink {
+  const Submitter::FormParameters &form;
+
+public:
+  FormSink(const char *name, const Submitter::FormParameters &form) : Sink(name), form(form) {}
+
+  bool configured() const override {
+    return &form == &blasticForm ? !config.submit.skipPPForm : std::strlen(form.urn);
+  }
+
+  Result submit(const Measurement *batch, size_t n, const Collector &collector) override {
+    if (!std::strlen(form.urn) || !std::strlen(form.type) || !std::strlen(form.collectionPoint) ||
+        !std::strlen(form.weight))
+      return {State::UNCONFIGURED, 0};
+    // the cached encodings are of the current names, a replayed batch may have older ones
+    const char *collectionPoint = encodedCollectionPoint, *collectorName = encodedCollectorName;
+    static EncodedParam replayedCollectionPoint, replayedCollectorName;
+    if (!collector.isCurrent()) {
+      util::urlEncode(replayedCollectionPoint, sizeof(replayedCollectionPoint), collector.collectionPoint);
+      util::urlEncode(replayedCollectorName, sizeof(replayedCollectorName),
+                      std::strlen(collector.collectorName) ? collector.collectorName : userAgent);
+      collectionPoint = replayedCollectionPoint;
+      collectorName = replayedCollectorName;
+    }
+    Urn urn(form.urn);
+    for (auto measurement = batch; measurement < batch + n; measurement++) {
+      auto &formData = encode(*measurement, collectionPoint, collectorName);
+      auto result = post(urn, "application/x-www-form-urlencoded", formData.length(), nullptr, [&](Print &body) {
+        body.write(reinterpret_cast<const uint8_t *>(formData.data()), formData.length());
+      });
+      // the form is considered successful only with a plain 200
+      if (result.state == State::OK && result.code != 200) result.state = State::REJECTED;
+      if (result.state != State::OK) return result;
+    }
+    return {State::OK, 200};
+  }
+
+private:
+  decltype(formBody) &encode(const Measurement &measurement, const char *encodedCollectionPoint,
+                             const char *encodedCollectorName) const {
+    auto &formData = formBody.clear();
+    auto type = measurement.type;
+    formData += form.type;
+    formData += '=';
+    formData += unicodePlasticSymbols[uint8_t(type) - 1];
+    // workaround for wrongly formatted entries (only ♶LDPE, ♷PP, ♸PS)
+    if (&form != &blasticForm || !config.submit.spacesWorkaroundPPForm ||
+        (type != plastic::LDPE && type != plastic::PP && type != plastic::PS))
+      formData += '+'; // space
+    formData += plasticName(type);
+    formData += '&';
+    formData += form.collectionPoint;
+    formData += '=';
+    formData += encodedCollectionPoint;
+    formData += '&';
+    formData += form.weight;
+    formData += '=';
+    char weightStr[maxFloatLength + 1];
+    formData += dtostrf(measurement.weight, 4, 2, weightStr);
+    formData += '&';
+    formData += form.collectorName;
+    formData += '=';
+    formData += encodedCollectorName;
+    configASSERT(!formData.overflow());
+    return formData;
+  }
+};
+
+/*
+  JSON encoding, for the batched POST and MQTT messages:
+
+  {"collectionPoint":"...","collectorName":"...","measurements":[{"epoch":1700000000,"type":"PET","weight":1.25},...]}
+*/
+
+void printJsonString(Print &p, const char *str) {
+  p.print('"');
+  for (; *str; str++) {
+    auto c = *str;
+    if (c == '"' || c == '\\') {
+      p.print('\\');
+      p.print(c);
+    } else if (uint8_t(c) < 0x20) {
+      constexpr const char hexDigits[] = "0123456789abcdef";
+      p.print("\\u00");
+      p.print(hexDigits[c >> 4]);
+      p.print(hexDigits[c & 0xf]);
+    } else p.print(c);
+  }
+  p.print('"');
+}
+
+void printJson(Print &p, const Measurement *batch, size_t n, const Collector &collector) {
+  p.print("{\"collectionPoint\":");
+  printJsonString(p, collector.collectionPoint);
+  p.print(",\"collectorName\":");
+  printJsonString(p, std::strlen(collector.collectorName) ? collector.collectorName : userAgent);
+  p.print(",\"measurements\":[");
+  for (auto measurement = batch; measurement < batch + n; measurement++) {
+    if (measurement != batch) p.print(',');
+    p.print("{\"epoch\":");
+    p.print(measurement->epoch);
+    p.print(",\"type\":\"");
+    p.print(plasticName(measurement->type));
+    p.print("\",\"weight\":");
+    p.print(measurement->weight, 2);
+    p.print('}');
+  }
+  p.print("]}");
+}
+
+size_t jsonLength(const Measurement *batch, size_t n, const Collector &collector) {
+  util::CountingPrint counter;
+  printJson(counter, batch, n, collector);
+  return counter.count;
+}
+
+/*
+  Batched JSON POST: the whole batch is sent in one request, streamed with a precomputed Content-Length.
+*/
+
+class JsonSink : public Sink {
+public:
+  using Sink::Sink;
+
+  bool configured() const override { return std::strlen(config.submit.json.urn); }
+
+  Result submit(const Measurement *batch, size_t n, const Collector &collector) override {
+    auto &json = config.submit.json;
+    return post(Urn(json.urn), "application/json", jsonLength(batch, n, collector), json.token,
+                [&](Print &body) { printJson(body, batch, n, collector); });
+  }
+};
+
+/*
+  Follows the MQTT packets of one direction of the connection, byte by byte, and extracts the packet id of PUBACK and of
+  PUBLISH with QoS > 0 (where it follows the topic).
+*/
+
+class MqttPacketScanner {
+  enum State : uint8_t { HEADER, LENGTH, BODY } state = HEADER;
+  uint8_t header, shift;
+  uint32_t length, offset;
+  uint16_t topicLength;
+
+  uint8_t type() const { return header >> 4; }
+
+public:
+  static constexpr const uint8_t PUBLISH = 3, PUBACK = 4;
+  uint16_t id;
+
+  // returns the type of the packet when its id is complete, otherwise 0
+  uint8_t feed(uint8_t c) {
+    switch (state) {
+    case HEADER:
+      header = c;
+      length = shift = 0;
+      state = LENGTH;
+      return 0;
+    case LENGTH:
+      length |= uint32_t(c & 0x7f) << shift;
+      shift += 7;
+      if (c & 0x80) return 0;
+      offset = topicLength = 0;
+      state = length ? BODY : HEADER;
+      return 0;
+    case BODY: {
+      auto at = offset++;
+      if (offset == length) state = HEADER;
+      bool publish = type() == PUBLISH;
+      if (publish && at < 2) {
+        topicLength = topicLength << 8 | c;
+        return 0;
+      }
+      if (!(publish ? header & 0x06 : type() == PUBACK)) return 0;
+      auto idAt = publish ? 2u + topicLength : 0u;
+      if (at == idAt) id = c << 8;
+      else if (at == idAt + 1) {
+        id |= c;
+        return type();
+      }
+      return 0;
+    }
+    }
+    return 0;
+  }
+};
+
+/*
+  ArduinoMqttClient does not report the PUBACKs it receives: this Client sits between it and the TLS connection, records
+  the ids of the QoS 1 messages published and clears them as the broker acknowledges them.
+*/
+
+class PubackTracker : public Client {
+  Client &client;
+  MqttPacketScanner sent, received;
+  uint16_t unacknowledged[maxReplayBatch];
+  size_t pending = 0, published = 0;
+
+  void scanSent(const uint8_t *buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      if (sent.feed(buffer[i]) != MqttPacketScanner::PUBLISH || pending == std::size(unacknowledged)) continue;
+      unacknowledged[pending++] = sent.id;
+      published++;
+    }
+  }
+
+  void scanReceived(const uint8_t *buffer, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      if (received.feed(buffer[i]) != MqttPacketScanner::PUBACK) continue;
+      auto end = unacknowledged + pending;
+      auto id = std::find(unacknowledged, end, received.id);
+      if (id == end) continue;
+      *id = end[-1];
+      pending--;
+    }
+  }
+
+public:
+  PubackTracker(Client &client) : client(client) {}
+
+  // all the n messages were published and acknowledged
+  bool acknowledged(size_t n) const { return published == n && !pending; }
+
+  int connect(IPAddress ip, uint16_t port) override { return client.connect(ip, port); }
+  int connect(const char *host, uint16_t port) override { return client.connect(host, port); }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override {
+    auto written = client.write(buffer, size);
+    scanSent(buffer, written);
+    return written;
+  }
+  int available() override { return client.available(); }
+  int read() override {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+  int read(uint8_t *buffer, size_t size) override {
+    auto n = client.read(buffer, size);
+    if (n > 0) scanReceived(buffer, n);
+    return n;
+  }
+  int peek() override { return client.peek(); }
+  void flush() override { client.flush(); }
+  void stop() override { client.stop(); }
+  uint8_t connected() override { return client.connected(); }
+  operator bool() override { return bool(client); }
+};
+
+/*
+  MQTT publisher, one QoS 1 message per measurement. The session is persistent (clean session flag not set), so the
+  broker keeps subscriptions and in-flight messages across the reconnections of each batch. The batch succeeds only
+  when the broker acknowledged all its messages, otherwise it is retried whole: the broker may see duplicates.
+*/
+
+class MqttSink : public Sink {
+public:
+  using Sink::Sink;
+
+  bool configured() const override {
+    return std::strlen(config.submit.mqtt.host) && std::strlen(config.submit.mqtt.topic);
+  }
+
+  Result submit(const Measurement *batch, size_t n, const Collector &collector) override {
+    auto &mqttConfig = config.submit.mqtt;
+    netstats::Stopwatch stopwatch;
+    if (!resolve(mqttConfig.host, stopwatch)) return {State::ERROR, 0};
+    SSLClient tls;
+    PubackTracker tracker(tls);
+    auto mqtt = std::make_unique<MqttClient>(tracker);
+    util::StringBuffer<sizeof(mqttConfig.clientId)> clientId;
+    if (std::strlen(mqttConfig.clientId)) clientId = mqttConfig.clientId;
+    else {
+      uint8_t mac[6];
+      MWiFi()->macAddress(mac);
+      snprintf(clientId, sizeof(clientId), "blastic-%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4],
+               mac[5]);
+    }
+    mqtt->setId(clientId);
+    if (std::strlen(mqttConfig.username)) mqtt->setUsernamePassword(mqttConfig.username, mqttConfig.password);
+    mqtt->setCleanSession(false);
+    if (!mqtt->connect(mqttConfig.host, mqttConfig.port)) {
+      auto error = mqtt->connectError();
+      MSerial serial;
+      serial->print("sinks: mqtt connection error ");
+      serial->println(error);
+      return {error > 0 ? State::REJECTED : State::ERROR, error};
+    }
+    stopwatch.lap(netstats::Phase::tlsConnect);
+    for (auto measurement = batch; measurement < batch + n; measurement++) {
+      if (!mqtt->beginMessage(mqttConfig.topic, jsonLength(measurement, 1, collector), false, 1))
+        return {State::ERROR, 0};
+      printJson(*mqtt, measurement, 1, collector);
+      if (!mqtt->endMessage()) return {State::ERROR, 0};
+    }
+    stopwatch.lap(netstats::Phase::request);
+    constexpr const uint32_t timeout = 5000;
+    for (auto start = millis(); !tracker.acknowledged(n);) {
+      if (millis() - start >= timeout || !mqtt->connected()) {
+        mqtt->stop();
+        MSerial()->print("sinks: mqtt messages not acknowledged\n");
+        return {State::ERROR, 0};
+      }
+      mqtt->poll();
+      if (!tracker.acknowledged(n)) vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    mqtt->stop();
+    return {State::OK, 0};
+  }
+};
+
+FormSink blasticFormSink("", blasticForm), userFormSink("user", config.submit.userForm);
+JsonSink jsonSink("json");
+MqttSink mqttSink("mqtt");
+Sink *const allSinks[]{&blasticFormSink, &userFormSink, &jsonSink, &mqttSink};
+
+/*
+  Append the network phase timings of the last submission to netstats.csv.
+*/
+
+static AppendFile netstatsLog("netstats.csv", [](Print &csv) {
+  csv.print("epoch");
+  for (auto name : netstats::phaseNames) {
+    csv.print(',');
+    csv.print(name);
+  }
+  csv.println();
+});
+
+void logNetstats() {
+  using namespace netstats;
+  util::StringBuilder<12 * (1 + size_t(Phase::count)) + 2> row;
+  char number[12];
+  snprintf(number, sizeof(number), "%d", ntp::unixTime());
+  row += number;
+  for (size_t phase = 0; phase < size_t(Phase::count); phase++) {
+    snprintf(number, sizeof(number), ",%lu", (unsigned long)lastSubmission(Phase(phase)));
+    row += number;
+  }
+  row += "\r\n";
+  SDCard sd(config.sdcard.CSPin);
+  if (sd && !netstatsLog.append(sd, row.data(), row.length()))
+    MSerial()->print("sinks: cannot write to netstats.csv\n");
+}
+
+} // namespace
+
+Dispatcher::Dispatcher(const char *name, UBaseType_t priority)
+    : queue(xQueueCreateStatic(queueLength, sizeof(Item), queueObjectsBuff, &queueBuff)),
+      reports(xQueueCreateStatic(reportsLength, sizeof(Report), reportsObjectsBuff, &reportsBuff)),
+      task(Dispatcher::loop, this, name, priority) {}
+
+bool Dispatcher::push(const Measurement &measurement, bool report, TickType_t timeout) {
+  Item item{Item::SUBMIT, report, measurement};
+  return xQueueSend(queue, &item, timeout);
+}
+
+bool Dispatcher::receiveReport(Report &report, TickType_t timeout) { return xQueueReceive(reports, &report, timeout); }
+
+bool Dispatcher::replay(int32_t fromEpoch, TickType_t timeout) {
+  Item item{Item::REPLAY, false, {fromEpoch}};
+  return xQueueSend(queue, &item, timeout);
+}
+
+bool Dispatcher::resumeReplay(TickType_t timeout) {
+  Item item{Item::RESUME_REPLAY};
+  return xQueueSend(queue, &item, timeout);
+}
+
+bool Dispatcher::stopReplay(TickType_t timeout) {
+  Item item{Item::STOP_REPLAY};
+  return xQueueSend(queue, &item, timeout);
+}
+
+void Dispatcher::report(const Report &report) {
+  if (!xQueueSend(reports, &report, 0)) MSerial()->print("sinks: reports queue full\n");
+}
+
+/*
+  Live measurements that a sink did not accept because of network or server errors are kept in the retry buffer of the
+  sink, and resubmitted to that sink alone with an exponential backoff. The buffer holds maxBatch measurements: the
+  oldest are dropped when it overflows, or when the names they were collected under are no longer the current ones.
+  Dropped measurements are still in the log, and can be resubmitted with submit::replay.
+*/
+
+static constexpr const uint32_t firstRetryDelay = 30000, maxRetryDelay = 600000;
+
+static bool retriable(const Result &result) {
+  return result.state == State::ERROR || (result.state == State::REJECTED && result.code >= 500);
+}
+
+void Sink::drop(size_t n, const char *reason) {
+  std::copy(retry + n, retry + retrying, retry);
+  retrying -= n;
+  MSerial serial;
+  serial->print("sinks: dropping ");
+  serial->print(n);
+  serial->print(" measurements for sink '");
+  serial->print(name);
+  serial->print("' (");
+  serial->print(reason);
+  serial->print("), resubmit them with submit::replay\n");
+}
+
+void Sink::keep(const Measurement *batch, size_t n, uint32_t collector) {
+  if (retrying && retryCollector != collector) drop(retrying, "names changed");
+  if (retrying + n > maxBatch) drop(retrying + n - maxBatch, "retry buffer full");
+  std::copy(batch, batch + n, retry + retrying);
+  retrying += n;
+  retryCollector = collector;
+}
+
+/*
+  Submit a batch to all the configured sinks, over a single WiFi connection. Returns true if all the sinks accepted it.
+*/
+
+bool Dispatcher::dispatch(const Measurement *batch, size_t n, const Collector &collector, bool live, bool reportBatch) {
+  auto send = [&](Report report) {
+    report.count = n;
+    if (reportBatch) this->report(report);
+  };
+  auto collectorHash = datalog::collectorHash(collector.collectionPoint, collector.collectorName);
+  auto keep = [&](Sink *sink, const Result &result) {
+    if (!live || !retriable(result)) return;
+    sink->keep(batch, n, collectorHash);
+    if (retryDelay) return;
+    retryMillis = millis();
+    retryDelay = firstRetryDelay;
+  };
+  auto keepAll = [&]() {
+    for (auto sink : allSinks)
+      if (sink->configured()) keep(sink, {State::ERROR, 0});
+  };
+  if (debug) {
+    MSerial serial;
+    serial->print("sinks: dispatching batch of ");
+    serial->println(n);
+  }
+
+  if (!Layer3::firmwareCompatible()) {
+    keepAll();
+    send({nullptr, Report::FIRMWARE, true, {State::ERROR, 0}});
+    return false;
+  }
+  bool ok = true;
+  netstats::beginSubmission();
+  {
+    Layer3 l3(config.wifi);
+    if (!l3) {
+      if (debug) MSerial()->print("sinks: failed to connect to wifi\n");
+      keepAll();
+      send({nullptr, Report::WIFI, true, {State::ERROR, 0}});
+      return false;
+    }
+    for (auto sink : allSinks) {
+      if (!sink->configured()) continue;
+      auto result = sink->submit(batch, n, collector);
+      if (result.state != State::OK) {
+        ok = false;
+        MSerial serial;
+        serial->print("sinks: failed to submit ");
+        serial->print(n);
+        serial->print(" measurements to sink '");
+        serial->print(sink->name);
+        serial->print("'\n");
+        keep(sink, result);
+      }
+      send({sink, Report::NO_ERROR, false, result});
+    }
+  }
+  send({nullptr, Report::NO_ERROR, true, {State::OK, 0}});
+  if (netstats::logToSD) logNetstats();
+  return ok;
+}
+
+// the ticks until the retry of the failed live measurements, portMAX_DELAY if there are none
+TickType_t Dispatcher::retryWait() const {
+  if (!retryDelay) return portMAX_DELAY;
+  auto elapsed = millis() - retryMillis;
+  return elapsed >= retryDelay ? 0 : pdMS_TO_TICKS(retryDelay - elapsed);
+}
+
+void Dispatcher::retryFailed() {
+  auto collector = Collector::current();
+  auto collectorHash = datalog::collectorHash(collector.collectionPoint, collector.collectorName);
+  bool pending = false;
+  for (auto sink : allSinks) {
+    if (!sink->retrying) continue;
+    if (!sink->configured()) sink->drop(sink->retrying, "unconfigured");
+    else if (sink->retryCollector != collectorHash) sink->drop(sink->retrying, "names changed");
+    else pending = true;
+  }
+  bool failed = false;
+  if (pending && Layer3::firmwareCompatible()) {
+    netstats::beginSubmission();
+    Layer3 l3(config.wifi);
+    for (auto sink : allSinks) {
+      if (!sink->retrying) continue;
+      auto result = l3 ? sink->submit(sink->retry, sink->retrying, collector) : Result{State::ERROR, 0};
+      MSerial serial;
+      serial->print(result.state == State::OK ? "sinks: resubmitted " : "sinks: failed to resubmit ");
+      serial->print(sink->retrying);
+      serial->print(" measurements to sink '");
+      serial->print(sink->name);
+      serial->print("'\n");
+      if (result.state == State::OK) sink->retrying = 0;
+      else if (retriable(result)) failed = true;
+      else sink->drop(sink->retrying, "rejected");
+    }
+  } else failed = pending;
+  retryMillis = millis();
+  retryDelay = failed ? std::min(2 * retryDelay, maxRetryDelay) : 0;
+}
+
+void Dispatcher::loop() [[noreturn]] {
+  Item item;
+  Measurement batch[maxBatch];
+  while (true) {
+    // live measurements take precedence over the retries, and these over the replay
+    if (!xQueueReceive(queue, &item, replaying ? 0 : retryWait())) {
+      if (!retryWait()) {
+        retryFailed();
+        continue;
+      }
+      if (!replaying) continue;
+      auto n = replaying.read(replayBatch, maxReplayBatch);
+      if (!n) continue;
+      if (dispatch(replayBatch, n, replaying.collector(), false, false)) replaying.commit();
+      else replaying.end("submission failed, resume with submit::replay");
+      continue;
+    }
+
+    size_t n = 0;
+    bool reportBatch = false;
+    do {
+      switch (item.command) {
+      case Item::SUBMIT:
+        batch[n++] = item.measurement;
+        reportBatch |= item.report;
+        break;
+      case Item::REPLAY:
+      case Item::RESUME_REPLAY:
+        if (std::none_of(std::begin(allSinks), std::end(allSinks), [](Sink *sink) { return sink->configured(); })) {
+          MSerial()->print("submit::replay: no sink configured\n");
+          break;
+        }
+        if (item.command == Item::REPLAY) replaying.begin(item.measurement.epoch);
+        else replaying.resume();
+        break;
+      case Item::STOP_REPLAY: replaying.end("stopped"); break;
+      }
+    } while (n < maxBatch && xQueueReceive(queue, &item, 0));
+    if (n) dispatch(batch, n, Collector::current(), true, reportBatch);
+  }
+}
+
+Dispatcher &dispatcher() {
+  static Dispatcher dispatcher("SinksDispatcher", configMAX_PRIORITIES / 2 - 1);
+  return dispatcher;
+}
+
+} // namespace sinks
+
+} // namespace blastic
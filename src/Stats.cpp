@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <memory>
+#include "blastic.h"
+#include "Stats.h"
+#include "DataLog.h"
+
+namespace blastic {
+
+namespace stats {
+
+void Aggregate::add(float weight) {
+  min = count ? std::min(min, weight) : weight;
+  max = count ? std::max(max, weight) : weight;
+  sum += weight;
+  count++;
+}
+
+Aggregate &Aggregate::operator+=(const Aggregate &o) {
+  if (!o.count) return *this;
+  min = count ? std::min(min, o.min) : o.min;
+  max = count ? std::max(max, o.max) : o.max;
+  sum += o.sum;
+  count += o.count;
+  return *this;
+}
+
+namespace {
+
+constexpr const char path[] = "STATS.BIN";
+
+struct Header {
+  static constexpr const uint32_t expectedSignature = ((uint32_t('B') << 8 | 'L') << 8 | 'S') << 8 | 'S';
+  static constexpr const uint32_t currentVersion = 1;
+  uint32_t signature, version;
+};
+
+// the file layout, never instantiated in memory
+struct Layout {
+  Header header;
+  TypeAggregates totals;
+  Day days[dayWindow];
+  Collector collectors[collectorSlots];
+};
+
+constexpr const int32_t secondsPerDay = 24 * 60 * 60;
+
+size_t typeIndex(plastic type) { return std::min<size_t>(uint8_t(type) - 1, std::size(plastics) - 1); }
+
+bool readAt(File &file, uint32_t offset, void *data, size_t length) {
+  return file.seek(offset) && file.read(data, length) == int(length);
+}
+
+bool writeAt(File &file, uint32_t offset, const void *data, size_t length) {
+  return file.seek(offset) && file.write(static_cast<const uint8_t *>(data), length) == length;
+}
+
+/*
+  Open the file, creating it zeroed if it is missing or has a different layout.
+*/
+
+File open(SDCard &sd) {
+  auto file = sd->open(path, O_CREAT | O_RDWR);
+  if (!file) return file;
+  Header header;
+  if (file.size() == sizeof(Layout) && readAt(file, 0, &header, sizeof(header)) &&
+      header.signature == Header::expectedSignature && header.version == Header::currentVersion)
+    return file;
+  MSerial()->print("stats: initializing STATS.BIN\n");
+  uint8_t zeros[64]{};
+  file.seek(0);
+  for (size_t written = 0; written < sizeof(Layout); written += sizeof(zeros))
+    file.write(zeros, std::min(sizeof(zeros), sizeof(Layout) - written));
+  header = {Header::expectedSignature, Header::currentVersion};
+  if (!writeAt(file, 0, &header, sizeof(header))) {
+    file.close();
+    sd.failed();
+    return {};
+  }
+  file.flush();
+  return file;
+}
+
+/*
+  Find the slot of a collector, or the least recently used one to replace.
+*/
+
+size_t findCollector(File &file, uint32_t collector, bool &found) {
+  size_t lru = 0;
+  int32_t lruEpoch = INT32_MAX;
+  for (size_t i = 0; i < collectorSlots; i++) {
+    uint32_t slotCollector;
+    int32_t lastEpoch;
+    auto offset = offsetof(Layout, collectors) + i * sizeof(Collector);
+    if (!readAt(file, offset + offsetof(Collector, collector), &slotCollector, sizeof(slotCollector)) ||
+        !readAt(file, offset + offsetof(Collector, lastEpoch), &lastEpoch, sizeof(lastEpoch)))
+      break;
+    if (slotCollector == collector) {
+      found = true;
+      return i;
+    }
+    if (!slotCollector) lastEpoch = INT32_MIN;
+    if (lastEpoch < lruEpoch) lru = i, lruEpoch = lastEpoch;
+  }
+  found = false;
+  return lru;
+}
+
+} // namespace
+
+bool add(SDCard &sd, int32_t epoch, float weight, plastic type, const char *collectionPoint,
+         const char *collectorName) {
+  auto file = open(sd);
+  if (!file) return false;
+  auto index = typeIndex(type);
+  bool ok = true;
+  Aggregate aggregate;
+  auto update = [&](uint32_t offset) {
+    ok = ok && readAt(file, offset, &aggregate, sizeof(aggregate));
+    aggregate.add(weight);
+    ok = ok && writeAt(file, offset, &aggregate, sizeof(aggregate));
+  };
+
+  update(offsetof(Layout, totals) + index * sizeof(Aggregate));
+
+  if (epoch) {
+    int32_t day = epoch / secondsPerDay, slotDay;
+    auto offset = offsetof(Layout, days) + (day % dayWindow) * sizeof(Day);
+    ok = ok && readAt(file, offset, &slotDay, sizeof(slotDay));
+    if (ok && slotDay != day) {
+      // the slot of a day out of the window, reuse it
+      Day fresh{};
+      fresh.day = day;
+      ok = writeAt(file, offset, &fresh, sizeof(fresh));
+    }
+    update(offset + offsetof(Day, types) + index * sizeof(Aggregate));
+  }
+
+  auto collector = datalog::collectorHash(collectionPoint, collectorName) ?: 1;
+  bool found;
+  auto offset = offsetof(Layout, collectors) + findCollector(file, collector, found) * sizeof(Collector);
+  if (!found) {
+    auto fresh = std::make_unique<Collector>();
+    fresh->collector = collector;
+    fresh->collectionPoint = collectionPoint;
+    fresh->collectorName = collectorName;
+    ok = ok && writeAt(file, offset, fresh.get(), sizeof(Collector));
+  }
+  ok = ok && writeAt(file, offset + offsetof(Collector, lastEpoch), &epoch, sizeof(epoch));
+  update(offset + offsetof(Collector, types) + index * sizeof(Aggregate));
+
+  file.close();
+  if (!ok) sd.failed();
+  return ok;
+}
+
+bool totals(SDCard &sd, TypeAggregates &types) {
+  auto file = open(sd);
+  auto ok = file && readAt(file, offsetof(Layout, totals), &types, sizeof(types));
+  file.close();
+  return ok;
+}
+
+bool day(SDCard &sd, int32_t epoch, TypeAggregates &types) {
+  auto file = open(sd);
+  int32_t day = epoch / secondsPerDay;
+  Day slot;
+  auto ok = file && readAt(file, offsetof(Layout, days) + (day % dayWindow) * sizeof(Day), &slot, sizeof(slot));
+  file.close();
+  if (!ok || slot.day != day) return false;
+  std::copy(std::begin(slot.types), std::end(slot.types), types);
+  return true;
+}
+
+bool collector(SDCard &sd, size_t slot, Collector &collector) {
+  auto file = open(sd);
+  auto offset = offsetof(Layout, collectors) + slot * sizeof(Collector);
+  auto ok = file && readAt(file, offset, &collector, sizeof(collector));
+  file.close();
+  return ok;
+}
+
+bool reset(SDCard &sd) {
+  if (sd->exists(path) && !sd->remove(path)) return false;
+  auto file = open(sd);
+  bool ok = file;
+  file.close();
+  return ok;
+}
+
+} // namespace stats
+
+} // namespace blastic
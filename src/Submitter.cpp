@@ -4,11 +4,16 @@
 #include "blastic.h"
 #include <ArduinoGraphics.h>
 #include <Arduino_LED_Matrix.h>
-#include <ArduinoHttpClient.h>
 #include <NTPClient.h>
 #include <WiFiUdp.h>
 #include "utils.h"
 #include "SDCard.h"
+#include "DataLog.h"
+#include "Stats.h"
+#include "FlashLog.h"
+#include "Sinks.h"
+#include "WarmState.h"
+#include "Boot.h"
 
 /*
   Annoyingly, the ArduinoLEDMatrix timer interrupt cannot be stopped.
@@ -166,6 +171,8 @@ HasTimedOut<Submitter::Action> Submitter::preview() {
   for (; millis() - lastInteractionMillis < idleTimeout;) {
     uint32_t cmd;
     if (xTaskNotifyWait(0, -1, &cmd, 0)) return toAction(cmd);
+    // leave the display to the reports of the uploads
+    if (sinks::dispatcher().reportsPending()) return Action::NONE;
     auto weight = scale::weight(config.scale, 1, pdMS_TO_TICKS(1000));
     if (abs(weight) < config.submit.threshold) weight.f = 0;
     else gotInput();
@@ -175,6 +182,7 @@ HasTimedOut<Submitter::Action> Submitter::preview() {
     else if (weight == scale::weightErr) painter = scroll("sensor error");
     else if (weight == 0) painter = scroll("0");
     else painter = show(weight);
+    if (!isnan(weight)) boot::mark(boot::Phase::weight);
   }
   return {};
 }
@@ -201,27 +209,35 @@ HasTimedOut<plastic> Submitter::plasticSelection() {
   }
 }
 
-static constexpr const char userAgent[] = "blastic-scale/" BLASTIC_GIT_COMMIT " (" BLASTIC_GIT_WORKTREE_STATUS ")";
-
 /*
-  Main submitter logic and UI.
+  Show the count and total weight of the measurements of today (UTC), from the running stats.
 */
 
-const char *const CSVHeader = "collectionPoint,collectorName,type,epoch,weight";
-
-static const Submitter::FormParameters blasticForm = []() {
-  Submitter::FormParameters form;
-  form.urn = "docs.google.com/forms/u/0/d/e/1FAIpQLSfmg2pnik2W7wLmmNigjfs4kgNBimxYe5ocRIpuLppBBE35fg/formResponse";
-  form.type = "entry.485899545";
-  form.collectionPoint = "entry.1447667805";
-  form.collectorName = "entry.436217948";
-  form.weight = "entry.1288178639";
-  return form;
-}();
+template <typename Notice> static void showTodayStats(Notice &notice) {
+  auto epoch = ntp::unixTime();
+  if (!epoch) {
+    notice("time unset");
+    return;
+  }
+  stats::TypeAggregates types;
+  stats::Aggregate today{};
+  {
+    SDCard sd(config.sdcard.CSPin);
+    if (!sd) {
+      notice("SD card error");
+      return;
+    }
+    // no slot for today means no measurements yet
+    if (stats::day(sd, epoch, types))
+      for (auto &type : types) today += type;
+  }
+  char sum[1 + 39 + 1 + 2 + 1];
+  notice(std::string("today ") + std::to_string(today.count) + "x " + dtostrf(today.sum, 1, 2, sum));
+}
 
-// ♳♴♵♶♷♸♹
-static constexpr const char *const unicodePlasticSymbols[] = {"%E2%99%B3", "%E2%99%B4", "%E2%99%B5", "%E2%99%B6",
-                                                              "%E2%99%B7", "%E2%99%B8", "%E2%99%B9"};
+/*
+  Main submitter logic and UI.
+*/
 
 void Submitter::loop() [[noreturn]] {
   // display initialization
@@ -238,26 +254,86 @@ void Submitter::loop() [[noreturn]] {
     return xTaskNotifyWait(0, -1, nullptr, pdMS_TO_TICKS(millis));
   };
 
-  // initial tare on start
-  {
+  auto takeTare = [&](const char *what) {
     constexpr const uint32_t scaleCliTimeout = 2000, scaleCliMaxMedianWidth = 16;
     auto tare = raw(config.scale, scaleCliMaxMedianWidth, pdMS_TO_TICKS(scaleCliTimeout));
-    if (tare == scale::readErr) {
-      MSerial()->print("submitter: initial tare failure\n");
-      notice("tare fail");
-    } else {
-      auto &calibration = config.scale.getCalibration();
-      calibration.tareRead = tare;
+    bool ok = tare != scale::readErr;
+    if (ok) {
+      config.scale.getCalibration().tareRead = tare;
+      warm::saveTare(config.scale.mode, tare);
+    }
+    MSerial serial;
+    serial->print("submitter: ");
+    serial->print(what);
+    if (!ok) {
+      serial->print(" tare failure\n");
+      return false;
+    }
+    serial->print(" tare ");
+    serial->println(tare);
+    return true;
+  };
+
+  // initial tare on start, or the tare from before a reset, refreshed the first time the scale sits empty and idle
+  bool refreshTare = false;
+  {
+    int32_t tare;
+    if (warm::tare(config.scale.mode, tare)) {
+      config.scale.getCalibration().tareRead = tare;
+      refreshTare = true;
       MSerial serial;
-      serial->print("submitter: initial tare ");
+      serial->print("submitter: warm tare ");
       serial->println(tare);
+      boot::done(boot::Job::tare);
+    } else {
+      bool tared = takeTare("initial");
+      boot::done(boot::Job::tare);
+      if (!tared) notice("tare fail");
     }
   }
 
+  // show the reports of the uploads that completed meanwhile
+  auto showReports = [&]() {
+    using sinks::Report, sinks::State;
+    Report report;
+    while (sinks::dispatcher().receiveReport(report, 0)) {
+      if (report.link == Report::FIRMWARE) notice("upgrade wifi firmware", 10000);
+      else if (report.link == Report::WIFI) notice("wifi error");
+      if (report.last) continue;
+      auto name = report.sink->name;
+      bool pp = !strlen(name);
+      std::string msg;
+      if (report.count > 1) msg = std::to_string(report.count) + "x ";
+      switch (report.result.state) {
+      case State::UNCONFIGURED:
+        if (!pp) continue;
+        msg += "bad form data";
+        break;
+      case State::ERROR: msg += pp ? "connect error" : "error"; break;
+      case State::REJECTED: {
+        char code[12];
+        snprintf(code, sizeof(code), "error %d", report.result.code);
+        msg += code;
+        break;
+      }
+      case State::OK: msg += "ok!"; break;
+      }
+      if (!pp) {
+        msg += " (";
+        msg += name;
+        msg += ')';
+      }
+      notice(std::move(msg), report.result.state == State::OK ? 2000 : 5000);
+    }
+  };
+
   while (true) {
+    showReports();
     if (debug) MSerial()->print("submitter: preview\n");
     auto action = preview();
     if (action.timedOut) {
+      // preview times out only after a minute below the threshold, the scale is empty
+      if (refreshTare) refreshTare = !takeTare("refreshed");
       if (debug) MSerial()->print("submitter: idling\n");
       LCDinterrupt.stop();
       for (int i = 0; i < matrixHeight * matrixWidth; i++) turnLed(i, false);
@@ -267,6 +343,10 @@ void Submitter::loop() [[noreturn]] {
     LCDinterrupt.start();
     xTimerStart(buttons::measurementTimer(), portMAX_DELAY);
     gotInput();
+    if (action == Action::BACK) {
+      showTodayStats(notice);
+      continue;
+    }
     if (action != Action::OK) continue;
 
     // got action OK, start submission
@@ -298,8 +378,18 @@ void Submitter::loop() [[noreturn]] {
     painter = scroll(plasticName(plastic), 200, 100, 2);
     xTaskNotifyWait(0, -1, nullptr, pdMS_TO_TICKS(2000));
 
-    // log entry to csv
+    // the time sync may still be running after a cold boot
+    constexpr const uint32_t timeSyncWait = 10000;
+    if (!ntp::unixTime() && !boot::wait(boot::Job::time, 0)) {
+      painter = scroll("time...");
+      boot::wait(boot::Job::time, pdMS_TO_TICKS(timeSyncWait));
+    }
+    auto epoch = ntp::unixTime();
+    if (!epoch) notice("time unset");
+
+    // log the measurement, to the flash log if the SD card is missing or failing
     const char *SDNotice = nullptr;
+    bool logged = false;
     {
       SDCard sd(blastic::config.sdcard.CSPin);
       if (!sd) {
@@ -311,149 +401,31 @@ void Submitter::loop() [[noreturn]] {
         }
         goto SDEnd;
       }
-      auto csv = sd->open("data.csv", O_CREAT | O_APPEND | O_WRITE);
-      if (!csv) {
-        MSerial()->print("submitter: cannot open file data.csv for writing\n");
-        SDNotice = "CSV open err";
+      flashlog::migratePending(sd);
+      if (!datalog::append(sd, epoch, weight, plastic)) {
+        MSerial()->print("submitter: could not write the measurement to the log\n");
+        SDNotice = "log write err";
         goto SDEnd;
       }
-      auto epoch = ntp::unixTime();
-      if (!epoch) notice("time unset");
-      if (!csv.size()) csv.println(CSVHeader);
-      csv.print(config.collectionPoint);
-      csv.print(',');
-      csv.print(config.collectorName);
-      csv.print(',');
-      csv.print(plasticName(plastic));
-      csv.print(',');
-      csv.print(epoch);
-      csv.print(',');
-      csv.println(weight);
-      csv.close();
-      if (csv.getWriteError()) {
-        MSerial serial;
-        serial->print("submitter: could not write all data to data.csv\n");
-        SDNotice = "CSV write err";
-      } else if (debug) MSerial()->print("submitter: entry written successfully to csv\n");
+      logged = true;
+      if (debug) MSerial()->print("submitter: measurement written successfully to the log\n");
+      if (!stats::add(sd, epoch, weight, plastic, config.collectionPoint, config.collectorName))
+        MSerial()->print("submitter: could not update the stats\n");
     }
   SDEnd:
-    if (SDNotice) notice(SDNotice);
-
-    // send to google form
-    using namespace wifi;
-    if (!Layer3::firmwareCompatible()) {
-      notice("upgrade wifi firmware", 10000);
-      continue;
-    }
-    painter = scroll(blastic::config.submit.skipPPForm ? "user form =>=>=>" : "form =>=>=>");
-    {
-      Layer3 l3(blastic::config.wifi);
-      if (!l3) {
-        if (debug) MSerial()->print("submitter: failed to connect to wifi\n");
-        notice("wifi error");
-        continue;
-      }
-
-      enum { UNCONFIGURED, ERROR, OK };
-      auto upload = [plastic, weight](const FormParameters &form) {
-        const char *path = strchr(form.urn, '/');
-        FormParameters::Param serverAddress;
-        if (path) serverAddress.strncpy(form.urn, path - form.urn);
-        else {
-          serverAddress = form.urn;
-          path = "/";
-        }
-        if (!std::strlen(form.urn) || !std::strlen(form.type) || !std::strlen(form.collectionPoint) ||
-            !std::strlen(form.weight)) {
-          return std::make_tuple(UNCONFIGURED, 0);
-        }
-
-        SSLClient tls;
-        if (!tls.connect(serverAddress, HttpClient::kHttpsPort)) {
-          MSerial serial;
-          serial->print("submitter: failed to connect to ");
-          serial->println(serverAddress);
-          return std::make_tuple(ERROR, 0);
-        }
-
-        String formData;
-        formData += form.type;
-        formData += '=';
-        formData += unicodePlasticSymbols[uint8_t(plastic.t) - 1];
-        // workaround for wrongly formatted entries (only ♶LDPE, ♷PP, ♸PS)
-        if (form.urn != blasticForm.urn || !blastic::config.submit.spacesWorkaroundPPForm ||
-            (plastic.t != plastic::LDPE && plastic.t != plastic::PP && plastic.t != plastic::PS))
-          formData += '+'; // space
-        formData += plasticName(plastic);
-        formData += '&';
-        formData += form.collectionPoint;
-        formData += '=';
-        formData += URLEncoder.encode(blastic::config.submit.collectionPoint);
-        formData += '&';
-        formData += form.weight;
-        formData += '=';
-        formData += weight;
-        formData += '&';
-        formData += form.collectorName;
-        formData += '=';
-        formData += URLEncoder.encode(
-            std::strlen(blastic::config.submit.collectorName) ? blastic::config.submit.collectorName : userAgent);
-
-        auto https = std::make_unique<HttpClient>(tls, serverAddress, HttpClient::kHttpsPort);
-        https->beginRequest();
-        https->noDefaultRequestHeaders();
-        https->connectionKeepAlive();
-        https->post(path);
-        https->sendHeader("Host", serverAddress);
-        https->sendHeader("User-Agent", userAgent);
-        https->sendHeader("Content-Type", "application/x-www-form-urlencoded");
-        https->sendHeader("Content-Length", formData.length());
-        https->sendHeader("Accept", "*/*");
-        https->beginBody();
-        https->print(formData);
-        https->endRequest();
-
-        auto code = https->responseStatusCode();
-        if (debug || code != 200) {
-          MSerial serial;
-          serial->print("submitter: http status ");
-          serial->println(code);
-        }
-        return std::make_tuple(OK, code);
-      };
-
-      if (!blastic::config.submit.skipPPForm) {
-        auto [state, httpCode] = upload(blasticForm);
-        switch (state) {
-        case UNCONFIGURED: notice("bad form data"); break;
-        case ERROR: notice("connect error"); break;
-        case OK:
-          if (httpCode == 200) notice("ok!", 2000);
-          else {
-            std::string errorMsg = "error ";
-            errorMsg += httpCode;
-            notice(std::move(errorMsg));
-          }
-        }
-      }
-
-      if (strlen(blastic::config.submit.userForm.urn)) {
-        painter = scroll("user form =>=>=>");
-        auto [state, httpCode] = upload(config.userForm);
-        switch (state) {
-        case UNCONFIGURED: continue;
-        case ERROR: notice("error (user)"); break;
-        case OK:
-          if (httpCode == 200) notice("ok! (user)", 2000);
-          else {
-            std::string errorMsg = "error ";
-            errorMsg += httpCode;
-            errorMsg += " (user)";
-            notice(std::move(errorMsg));
-          }
-        }
+    if (!logged) {
+      if (flashlog::append(epoch, weight, plastic)) {
+        if (debug) MSerial()->print("submitter: measurement written to the flash log\n");
+      } else {
+        MSerial()->print("submitter: could not write the measurement to the flash log\n");
+        SDNotice = "log write err";
       }
     }
+    if (SDNotice) notice(SDNotice);
+
+    // queue for the configured sinks, their reports are shown as they come
+    if (!sinks::dispatcher().push({epoch, weight, plastic}, true)) notice("queue full");
+    else notice("queued", 2000);
   }
 }
 
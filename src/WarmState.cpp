@@ -0,0 +1,98 @@
+#include "blastic.h"
+#include "WarmState.h"
+
+namespace blastic {
+
+namespace warm {
+
+namespace {
+
+struct Record {
+  static constexpr const uint32_t expectedSignature = ((uint32_t('B') << 8 | 'L') << 8 | 'W') << 8 | 'S';
+  uint32_t signature;
+  State state;
+  uint32_t crc;
+
+  // seeded with the size, so that a firmware with a different layout reads a cold boot
+  uint32_t checksum() const { return util::crc32(this, offsetof(Record, crc), sizeof(Record)); }
+};
+
+static_assert(sizeof(Record) <= sizeof(R_SYSTEM->VBTBKR));
+
+// the copy in RAM, updated in a critical section together with the backup registers
+Record record;
+
+void read() {
+  auto bytes = reinterpret_cast<uint8_t *>(&record);
+  for (size_t i = 0; i < sizeof(record); i++) bytes[i] = R_SYSTEM->VBTBKR[i].VBTBKR;
+}
+
+// call in a critical section
+void write() {
+  record.crc = record.checksum();
+  auto bytes = reinterpret_cast<const uint8_t *>(&record);
+  R_BSP_RegisterProtectDisable(BSP_REG_PROTECT_OM_LPC_BATT);
+  for (size_t i = 0; i < sizeof(record); i++) R_SYSTEM->VBTBKR[i].VBTBKR = bytes[i];
+  R_BSP_RegisterProtectEnable(BSP_REG_PROTECT_OM_LPC_BATT);
+}
+
+// an epoch this old at most is restored after a reset
+constexpr const uint32_t epochSaveMillis = 10000;
+
+void saveEpoch(TimerHandle_t) {
+  auto epoch = ntp::unixTime();
+  if (!epoch) return;
+  taskENTER_CRITICAL();
+  record.state.epoch = epoch;
+  write();
+  taskEXIT_CRITICAL();
+}
+
+} // namespace
+
+bool begin() {
+  read();
+  bool valid = record.signature == Record::expectedSignature && record.crc == record.checksum();
+  if (valid) record.state.boots++;
+  else record = {Record::expectedSignature, {}, 0};
+  write();
+  static StaticTimer_t epochTimerBuff;
+  static TimerHandle_t epochTimer =
+      xTimerCreateStatic("warmEpoch", pdMS_TO_TICKS(epochSaveMillis), true, nullptr, saveEpoch, &epochTimerBuff);
+  configASSERT(xTimerStart(epochTimer, portMAX_DELAY));
+  return valid;
+}
+
+State get() {
+  taskENTER_CRITICAL();
+  auto state = record.state;
+  taskEXIT_CRITICAL();
+  return state;
+}
+
+bool tare(scale::HX711Mode mode, int32_t &tareRead) {
+  auto state = get();
+  if (!state.tareValid || state.tareMode != mode) return false;
+  tareRead = state.tareRead;
+  return true;
+}
+
+void saveTare(scale::HX711Mode mode, int32_t tareRead) {
+  taskENTER_CRITICAL();
+  record.state.tareRead = tareRead;
+  record.state.tareMode = mode;
+  record.state.tareValid = true;
+  write();
+  taskEXIT_CRITICAL();
+}
+
+void saveNetwork(uint32_t ssidHash) {
+  taskENTER_CRITICAL();
+  record.state.networkHash = ssidHash;
+  write();
+  taskEXIT_CRITICAL();
+}
+
+} // namespace warm
+
+} // namespace blastic
@@ -1,5 +1,9 @@
 #include "blastic.h"
 #include "StaticTask.h"
+#include "netstats.h"
+#include "murmur32.h"
+#include "WarmState.h"
+#include <algorithm>
 
 namespace wifi {
 
@@ -19,18 +23,122 @@ util::Looper<1024> &Layer3::background() {
   return background;
 }
 
-Layer3::Layer3(const Config &config) : util::Mutexed<::WiFi>(), backgroundJob(false) {
+Layer3::NetworkStats Layer3::networkStats[maxNetworks]{};
+
+// scan results are reused for this long, unless a connection fails
+static constexpr const uint32_t scanCacheMillis = 5 * 60 * 1000;
+// prefer the network that connected last, unless another one is much stronger
+static constexpr const int32_t lastSuccessBonus = 10;
+static bool scanValid = false;
+static uint32_t lastScanMillis;
+
+void Layer3::invalidateScan() { scanValid = false; }
+
+void Layer3::scan(const Networks &networks) {
+  if (scanValid && millis() - lastScanMillis < scanCacheMillis) return;
+  auto &wifi = **this;
+  auto found = wifi.scanNetworks();
+  if (found < 0) {
+    if (debug) MSerial()->print("wifi::scan: failed\n");
+    return;
+  }
+  for (size_t i = 0; i < networks.count; i++) {
+    auto &stats = networkStats[i];
+    stats.rssi = 0;
+    for (uint8_t j = 0; j < found; j++)
+      if (!strcmp(networks.list[i].ssid, wifi.SSID(j))) stats.rssi = max(stats.rssi ?: INT32_MIN, wifi.RSSI(j));
+  }
+  scanValid = true;
+  lastScanMillis = millis();
+}
+
+bool Layer3::connect(const Network &network, NetworkStats &stats, uint8_t dhcpTimeout) {
+  constexpr const uint32_t dhcpPollInterval = 100;
+  auto &wifi = **this;
+  stats.attempts++;
+  netstats::Stopwatch stopwatch;
+  auto start = millis();
+  if (wifi.begin(network.ssid, std::strlen(network.password) ? network.password : nullptr) != WL_CONNECTED) {
+    wifi.end();
+    return false;
+  }
+  stopwatch.lap(netstats::Phase::association);
+  auto dhcpStart = millis();
+  while (!*this && millis() - dhcpStart < dhcpTimeout * 1000) vTaskDelay(dhcpPollInterval);
+  if (!*this) {
+    wifi.end();
+    return false;
+  }
+  stopwatch.lap(netstats::Phase::dhcp);
+  auto elapsed = millis() - start;
+  stats.successes++;
+  stats.totalConnectMillis += elapsed;
+  stats.maxConnectMillis = max(stats.maxConnectMillis, elapsed);
+  stats.lastSuccessMillis = millis() ?: 1;
+  stats.rssi = wifi.RSSI();
+  warm::saveNetwork(stats.ssidHash);
+  return true;
+}
+
+Layer3::Layer3(const Networks &networks, uint8_t dhcpTimeout) : util::Mutexed<::WiFi>(), backgroundJob(false) {
   if (debug >= 1) modem.debug(Serial, debug - 1);
   if (!firmwareCompatible()) return;
-  constexpr const uint32_t dhcpPollInterval = 100;
   auto &wifi = **this;
   wifi.end();
-  if (!strlen(config.ssid)) return;
-  if (wifi.begin(config.ssid, std::strlen(config.password) ? static_cast<const char *>(config.password) : nullptr) !=
-      WL_CONNECTED)
+
+  // reset the statistics of the slots whose ssid changed
+  size_t candidates[maxNetworks], count = 0;
+  for (size_t i = 0; i < networks.count; i++) {
+    auto ssid = networks.list[i].ssid;
+    auto hash = util::murmur3_32(ssid, std::strlen(ssid));
+    if (networkStats[i].ssidHash != hash) {
+      networkStats[i] = {hash};
+      invalidateScan();
+    }
+    if (std::strlen(ssid)) candidates[count++] = i;
+  }
+  if (!count) return;
+  if (count == 1) {
+    connect(networks.list[candidates[0]], networkStats[candidates[0]], dhcpTimeout);
     return;
-  auto dhcpStart = millis();
-  while (!*this && millis() - dhcpStart < config.dhcpTimeout * 1000) vTaskDelay(dhcpPollInterval);
+  }
+
+  // first connection after a warm boot
+  auto warmNetwork = warm::get().networkHash;
+  if (warmNetwork && std::none_of(candidates, candidates + count, [](size_t i) { return networkStats[i].attempts; }))
+    for (size_t i = 0; i < count; i++) {
+      auto index = candidates[i];
+      if (networkStats[index].ssidHash != warmNetwork) continue;
+      if (connect(networks.list[index], networkStats[index], dhcpTimeout)) return;
+      warm::saveNetwork(0);
+      break;
+    }
+
+  scan(networks);
+  size_t lastSuccess = candidates[0];
+  for (size_t i = 0; i < count; i++)
+    if (networkStats[candidates[i]].lastSuccessMillis > networkStats[lastSuccess].lastSuccessMillis)
+      lastSuccess = candidates[i];
+  auto score = [&](size_t i) {
+    auto &stats = networkStats[i];
+    return stats.rssi + (i == lastSuccess && stats.lastSuccessMillis ? lastSuccessBonus : 0);
+  };
+  std::sort(candidates, candidates + count, [&](size_t a, size_t b) { return score(a) > score(b); });
+  // hidden networks do not show up in scans, try everything if nothing was found
+  bool anyInRange = std::any_of(candidates, candidates + count, [](size_t i) { return networkStats[i].rssi; });
+  for (size_t i = 0; i < count; i++) {
+    auto index = candidates[i];
+    if (scanValid && anyInRange && !networkStats[index].rssi) continue;
+    if (debug) {
+      MSerial serial;
+      serial->print("wifi::connect: trying ");
+      serial->print(networks.list[index].ssid);
+      serial->print(" rssi ");
+      serial->println(networkStats[index].rssi);
+    }
+    if (connect(networks.list[index], networkStats[index], dhcpTimeout)) return;
+  }
+  invalidateScan();
 }
 
 Layer3::operator bool() const {
@@ -38,20 +146,26 @@ Layer3::operator bool() const {
   return _this->status() == WL_CONNECTED && _this->localIP() && _this->gatewayIP() && _this->dnsIP();
 }
 
-int SSLClient::read() {
-  vTaskSuspendAll();
+SSLClient::ReadStats SSLClient::readStats{};
+
+template <typename ReadFunction> int SSLClient::guardedRead(ReadFunction &&read) {
+  MWiFi wifi;
+  auto start = micros();
   int result = -1;
-  if (connected()) result = ::WiFiSSLClient::read();
-  xTaskResumeAll();
+  if (connected()) result = read();
+  auto elapsed = micros() - start;
+  readStats.count++;
+  readStats.totalMicros += elapsed;
+  readStats.maxMicros = max(readStats.maxMicros, elapsed);
   return result;
 }
 
+int SSLClient::read() {
+  return guardedRead([this]() { return ::WiFiSSLClient::read(); });
+}
+
 int SSLClient::read(uint8_t *buf, size_t size) {
-  vTaskSuspendAll();
-  int result = -1;
-  if (connected()) result = ::WiFiSSLClient::read(buf, size);
-  xTaskResumeAll();
-  return result;
+  return guardedRead([=]() { return ::WiFiSSLClient::read(buf, size); });
 }
 
 Layer3::~Layer3() {
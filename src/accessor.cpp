@@ -1,5 +1,10 @@
+#include <base64.hpp>
+#include "DataFlashBlockDevice.h"
 #include "SerialCliTask.h"
 #include "blastic.h"
+#include "ConfigSchema.h"
+#include "netstats.h"
+#include "Sinks.h"
 
 namespace cli {
 
@@ -7,197 +12,220 @@ using namespace blastic;
 
 namespace {
 
-template <typename T> void valuePrinter(const T &field) {
-  MSerial serial;
-  serial->print("get: ");
-  serial->println(field);
-}
+using eeprom::schema::Field;
+using eeprom::schema::FieldType;
 
-template <size_t size> void valuePrinter(const util::StringBuffer<size> &field) {
-  MSerial serial;
-  serial->print("get: '");
-  serial->print(field);
-  serial->println('\'');
-}
+template <typename T> void valuePrinter(Print &p, const T &field) { p.print(field); }
 
-void valuePrinter(scale::HX711Mode field) {
-  MSerial serial;
-  serial->print("get: ");
-  serial->println(scale::modeStrings[uint32_t(field)]);
-}
+void valuePrinter(Print &p, float field) { p.print(field, 6); }
 
-void valuePrinter(e_ctsu_ico_gain field) {
-  MSerial serial;
-  serial->print("get: ");
+void valuePrinter(Print &p, scale::HX711Mode field) { p.print(scale::modeStrings[uint32_t(field)]); }
+
+void valuePrinter(Print &p, e_ctsu_ico_gain field) {
   int modes[]{100, 66, 50, 40};
-  serial->println(modes[field]);
+  p.print(modes[field]);
 }
 
-void valuePrinter(ctsu_clock_div_t field) {
-  MSerial serial;
-  serial->print("get: ");
-  serial->println(int(field) * 2 + 2);
-}
+void valuePrinter(Print &p, ctsu_clock_div_t field) { p.print(int(field) * 2 + 2); }
 
-void valuePrinter(const util::AnnotatedFloat &field) {
-  MSerial serial;
-  serial->print("get: ");
-  serial->print(field);
-  if (isnan(field)) {
-    serial->print(':');
-    char annotation[4];
-    field.getAnnotation(annotation);
-    serial->println(annotation);
-  } else serial->println();
+void valuePrinter(Print &p, const util::AnnotatedFloat &field) {
+  valuePrinter(p, float(field));
+  if (!isnan(field)) return;
+  p.print(':');
+  char annotation[4];
+  field.getAnnotation(annotation);
+  p.print(annotation);
 }
 
-template <size_t size> void valueParser(WordSplit &args, util::StringBuffer<size> &field, auto &&validate) {
-  auto value = args.rest(false, false);
-  if (!value) {
-    MSerial()->print("set: unspecified value\n");
-    return;
-  }
-set:
-  if (!validate(value)) {
-    MSerial()->print("set: invalid string\n");
-    return;
-  }
-  field = value;
-  MSerial serial;
-  serial->print("set: ok '");
-  serial->print(field);
-  serial->print("'\n");
+/*
+  The parsers read a value from args into value, and return nullptr or an error message.
+*/
+
+constexpr const char unspecified[] = "unspecified value", unparsable[] = "cannot parse value";
+
+// the rest of the line, without the quotes printed by get if present
+const char *valueParser(WordSplit &args, char *value, size_t size) {
+  auto str = args.rest(false, false);
+  if (!str) return unspecified;
+  auto len = strlen(str);
+  if (len >= 2 && str[0] == '\'' && str[len - 1] == '\'') str++, len -= 2;
+  len = std::min(len, size - 1);
+  memcpy(value, str, len);
+  memset(value + len, 0, size - len);
+  return nullptr;
 }
 
-void valueParser(WordSplit &args, scale::HX711Mode &field, auto &&validate) {
-  auto value = args.nextWord();
-  if (!value) {
-    MSerial()->print("set: unspecified value\n");
-    return;
-  }
+const char *valueParser(WordSplit &args, scale::HX711Mode &value) {
+  auto svalue = args.nextWord();
+  if (!svalue) return unspecified;
   for (int i = 0; i < std::size(scale::modeStrings); i++)
-    if (!strcmp(scale::modeStrings[i], value)) {
-      auto mode = scale::HX711Mode(i);
-      if (!validate(mode)) {
-        MSerial()->print("set: invalid mode\n");
-        return;
-      }
-      field = mode;
-      MSerial serial;
-      serial->print("set: ok ");
-      serial->println(value);
-      return;
+    if (!strcmp(scale::modeStrings[i], svalue)) {
+      value = scale::HX711Mode(i);
+      return nullptr;
     }
-  MSerial()->print("set: cannot parse mode value\n");
+  return "cannot parse mode value";
 }
 
-void valueParser(WordSplit &args, e_ctsu_ico_gain &field, auto &&validate) {
+const char *valueParser(WordSplit &args, e_ctsu_ico_gain &value) {
   char *svalue = args.nextWord(), *svalueEnd;
-  if (!svalue) {
-    MSerial()->print("set: unspecified value\n");
-    return;
-  }
-  auto value = strtoull(svalue, &svalueEnd, 10);
-  if (svalue == svalueEnd) {
-    MSerial()->print("set: cannot parse value\n");
-    return;
+  if (!svalue) return unspecified;
+  switch (strtoul(svalue, &svalueEnd, 10)) {
+  case 100: value = CTSU_ICO_GAIN_100; return nullptr;
+  case 66: value = CTSU_ICO_GAIN_66; return nullptr;
+  case 50: value = CTSU_ICO_GAIN_50; return nullptr;
+  case 40: value = CTSU_ICO_GAIN_40; return nullptr;
+  default: return svalue == svalueEnd ? unparsable : "invalid gain";
   }
-  switch (value) {
-  case 100: field = CTSU_ICO_GAIN_100; break;
-  case 66: field = CTSU_ICO_GAIN_66; break;
-  case 50: field = CTSU_ICO_GAIN_50; break;
-  case 40: field = CTSU_ICO_GAIN_40; break;
-  default: MSerial()->print("set: invalid gain\n"); return;
+}
+
+const char *valueParser(WordSplit &args, ctsu_clock_div_t &value) {
+  char *svalue = args.nextWord(), *svalueEnd;
+  if (!svalue) return unspecified;
+  auto div = strtoul(svalue, &svalueEnd, 10);
+  if (svalue == svalueEnd) return unparsable;
+  if (!div || div > 64 || div % 2) return "invalid divider";
+  value = ctsu_clock_div_t(div / 2 - 1);
+  return nullptr;
+}
+
+// a number, or nan:<annotation> as printed by get
+const char *valueParser(WordSplit &args, util::AnnotatedFloat &value) {
+  char *svalue = args.nextWord(), *svalueEnd;
+  if (!svalue) return unspecified;
+  if (!strncmp(svalue, "nan:", 4)) {
+    value = util::AnnotatedFloat(svalue + 4);
+    return nullptr;
   }
-  MSerial serial;
-  serial->print("set: ok ");
-  serial->println(value);
+  value = util::AnnotatedFloat(strtof(svalue, &svalueEnd));
+  return svalue == svalueEnd || !isfinite(value) ? unparsable : nullptr;
 }
 
-void valueParser(WordSplit &args, e_ctsu_clock_div &field, auto &&validate) {
+template <typename T, typename std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
+const char *valueParser(WordSplit &args, T &value) {
   char *svalue = args.nextWord(), *svalueEnd;
-  if (!svalue) {
-    MSerial()->print("set: unspecified value\n");
-    return;
+  if (!svalue) return unspecified;
+  if constexpr (std::is_floating_point_v<T>) value = strtof(svalue, &svalueEnd);
+  else {
+    std::conditional_t<std::is_unsigned_v<T>, uint64_t, int64_t> parsed;
+    if constexpr (std::is_unsigned_v<T>) parsed = strtoull(svalue, &svalueEnd, 10);
+    else parsed = strtoll(svalue, &svalueEnd, 10);
+    if (svalue != svalueEnd && (parsed < std::numeric_limits<T>::min() || parsed > std::numeric_limits<T>::max()))
+      return "value is out of range";
+    value = parsed;
+  }
+  return svalue == svalueEnd ? unparsable : nullptr;
+}
+
+/*
+  Call f with the value of a config field, as a reference to its type (strings as char *).
+*/
+
+template <typename F> void visit(const Field &field, void *value, F &&f) {
+  switch (field.type) {
+  case FieldType::BOOL: return f(*static_cast<bool *>(value));
+  case FieldType::UINT8: return f(*static_cast<uint8_t *>(value));
+  case FieldType::UINT16: return f(*static_cast<uint16_t *>(value));
+  case FieldType::UINT32: return f(*static_cast<uint32_t *>(value));
+  case FieldType::INT32: return f(*static_cast<int32_t *>(value));
+  case FieldType::FLOAT: return f(*static_cast<float *>(value));
+  case FieldType::ANNOTATED_FLOAT: return f(*static_cast<util::AnnotatedFloat *>(value));
+  case FieldType::STRING: return f(static_cast<char *>(value));
+  case FieldType::HX711_MODE: return f(*static_cast<scale::HX711Mode *>(value));
+  case FieldType::CTSU_GAIN: return f(*static_cast<e_ctsu_ico_gain *>(value));
+  case FieldType::CTSU_DIV: return f(*static_cast<ctsu_clock_div_t *>(value));
   }
-  auto value = strtoull(svalue, &svalueEnd, 10);
-  if (svalue == svalueEnd) {
-    MSerial()->print("set: cannot parse value\n");
+}
+
+void fieldPrinter(Print &p, const Field &field, const void *value) {
+  if (field.type == FieldType::STRING) {
+    p.print('\'');
+    p.print(static_cast<const char *>(value));
+    p.print('\'');
     return;
   }
-  if (!value || value > 64 || value % 2) {
-    MSerial()->print("set: invalid gain\n");
+  visit(field, const_cast<void *>(value), [&p](auto &&v) { valuePrinter(p, v); });
+}
+
+void getField(const Field &field) {
+  MSerial serial;
+  serial->print("get: ");
+  fieldPrinter(*serial, field, field.in(config));
+  serial->print('\n');
+}
+
+// parse and validate a value of field into value, which holds the current one, returns nullptr or an error message
+const char *fieldParser(const Field &field, WordSplit &args, void *value) {
+  const char *error;
+  visit(field, value, [&](auto &&v) {
+    if constexpr (std::is_pointer_v<std::decay_t<decltype(v)>>) error = valueParser(args, v, field.size);
+    else error = valueParser(args, v);
+  });
+  if (error) return error;
+  return eeprom::schema::validate(field, value) ? nullptr : "invalid value";
+}
+
+bool fieldEqual(const Field &field, const void *a, const void *b) {
+  if (field.type == FieldType::STRING) return !strcmp(static_cast<const char *>(a), static_cast<const char *>(b));
+  return !memcmp(a, b, field.size);
+}
+
+void setField(const Field &field, WordSplit &args) {
+  alignas(uint32_t) uint8_t value[eeprom::schema::maxFieldSize()];
+  memcpy(value, field.in(config), field.size);
+  if (auto error = fieldParser(field, args, value)) {
+    MSerial serial;
+    serial->print("set: ");
+    serial->print(error);
+    serial->print('\n');
     return;
   }
-  field = ctsu_clock_div_t(value / 2 - 1);
+  memcpy(field.in(config), value, field.size);
+  if (field.flags & Field::NOTIFY) sinks::configChanged();
   MSerial serial;
   serial->print("set: ok ");
-  serial->println(value);
+  fieldPrinter(*serial, field, field.in(config));
+  serial->print('\n');
 }
 
-template <typename T, typename std::enable_if_t<std::is_arithmetic_v<T>, int> = 0>
-void valueParser(WordSplit &args, T &field, auto &&validate) {
-  char *svalue = args.nextWord(), *svalueEnd;
-  if (!svalue) {
-    MSerial()->print("set: unspecified value\n");
+template <typename T> void valueGetter(const T &field) {
+  MSerial serial;
+  serial->print("get: ");
+  valuePrinter(*serial, field);
+  serial->print('\n');
+}
+
+template <typename T> void valueSetter(WordSplit &args, T &field, auto &&validate) {
+  T value;
+  auto error = valueParser(args, value);
+  if (!error && !validate(value)) error = "invalid value";
+  if (error) {
+    MSerial serial;
+    serial->print("set: ");
+    serial->print(error);
+    serial->print('\n');
     return;
   }
-  auto checkParsed = [svalue, &svalueEnd]() {
-    if (svalue == svalueEnd) {
-      MSerial()->print("set: cannot parse value\n");
-      return false;
-    }
-    return true;
-  };
-  auto checkValid = [&validate](auto &value) {
-    if (!validate(value)) {
-      MSerial()->print("set: invalid value\n");
-      return false;
-    }
-    return true;
-  };
-  if constexpr (std::is_floating_point_v<T>) {
-    auto value = strtof(svalue, &svalueEnd);
-    if (!checkParsed() || !checkValid(value)) return;
-    field = value;
-  } else {
-    std::conditional_t<std::is_unsigned_v<T>, uint64_t, int64_t> value;
-    if constexpr (std::is_unsigned_v<T>) value = strtoull(svalue, &svalueEnd, 10);
-    else value = strtoll(svalue, &svalueEnd, 10);
-    if (!checkParsed()) return;
-    if (value < std::numeric_limits<T>::min() || value > std::numeric_limits<T>::max()) {
-      MSerial()->print("set: value is out of range\n");
-      return;
-    }
-    if (!checkValid(value)) return;
-    field = value;
-  }
+  field = value;
   MSerial serial;
   serial->print("set: ok ");
-  serial->println(field);
+  valuePrinter(*serial, field);
+  serial->print('\n');
 }
 
-void valueParser(WordSplit &args, float &field) {
-  valueParser(args, field, [](float v) { return isfinite(v); });
+template <typename T> void valueSetter(WordSplit &args, T &field) {
+  valueSetter(args, field, [](auto &&) { return true; });
 }
 
-template <typename T> void valueParser(WordSplit &args, T &field) {
-  valueParser(args, field, [](auto &&) { return true; });
-}
+/*
+  Accessors of values outside the config schema.
+*/
 
 #define makeAccessor(address, ...)                                                                                     \
   valueAccessor(                                                                                                       \
-      #address, []() { valuePrinter(address); },                                                                       \
-      [](WordSplit &args) { return valueParser(args, address, ##__VA_ARGS__); })
-#define makeAccessorRO(address) valueAccessor(#address, []() { valuePrinter(address); })
+      #address, []() { valueGetter(address); }, [](WordSplit &args) { valueSetter(args, address, ##__VA_ARGS__); })
+#define makeAccessorRO(address) valueAccessor(#address, []() { valueGetter(address); })
 #define makeStructFieldAccessorRO(prefix, lvalue, field)                                                               \
-  valueAccessor(prefix "." #field, []() { valuePrinter(lvalue.field); })
-#define makeStructFieldAccessor(prefix, lvalue, field, ...)                                                            \
-  valueAccessor(                                                                                                       \
-      prefix "." #field, []() { valuePrinter(lvalue.field); },                                                         \
-      [](WordSplit &args) { return valueParser(args, lvalue.field, ##__VA_ARGS__); })
-
-static bool validDigitalPin(uint8_t pin) { return pin <= 13; }
+  valueAccessor(prefix "." #field, []() { valueGetter(lvalue.field); })
 
 static constexpr const struct valueAccessor {
   using getter = void (*)();
@@ -214,51 +242,26 @@ static constexpr const struct valueAccessor {
     makeAccessor(debug, [](uint32_t debug) { return debug <= 2; }),
     makeAccessor(wifi::debug, [](uint32_t debug) { return debug <= 3; }),
     makeAccessor(scale::debug::fake),
+    makeAccessor(netstats::logToSD),
 
-    makeAccessor(config.scale.dataPin, validDigitalPin),
-    makeAccessor(config.scale.clockPin, validDigitalPin),
-    makeAccessor(config.scale.mode),
-#define makeCalibrationAccessors(prefix, lvalue)                                                                       \
-  makeStructFieldAccessorRO(prefix, lvalue, tareRead), makeStructFieldAccessorRO(prefix, lvalue, calibrationRead),     \
-      makeStructFieldAccessorRO(prefix, lvalue, calibrationWeight)
-    makeCalibrationAccessors("config.scale.calibration", config.scale.getCalibration()),
-    makeCalibrationAccessors("config.scale.calibrations.A128",
-                             config.scale.calibrations[uint32_t(scale::HX711Mode::A128)]),
-    makeCalibrationAccessors("config.scale.calibrations.B", config.scale.calibrations[uint32_t(scale::HX711Mode::B)]),
-    makeCalibrationAccessors("config.scale.calibrations.A64",
-                             config.scale.calibrations[uint32_t(scale::HX711Mode::A64)]),
-
-    makeAccessor(config.wifi.ssid),
-    makeAccessor(config.wifi.password),
-    makeAccessor(config.wifi.dhcpTimeout),
-    makeAccessor(config.wifi.idleTimeout),
-    makeAccessor(config.submit.threshold, [](float &v) { return (v = abs(v)) > 0; }),
-    makeAccessor(config.submit.skipPPForm),
-    makeAccessor(config.submit.spacesWorkaroundPPForm),
-    makeAccessor(config.submit.collectionPoint),
-    makeAccessor(config.submit.collectorName),
-    makeAccessor(config.submit.userForm.urn),
-    makeAccessor(config.submit.userForm.type),
-    makeAccessor(config.submit.userForm.collectionPoint),
-    makeAccessor(config.submit.userForm.collectorName),
-    makeAccessor(config.submit.userForm.weight),
-
-#define makeButtonAccessors(prefix, lvalue)                                                                            \
-  makeStructFieldAccessor(prefix, lvalue, pin, validDigitalPin), makeStructFieldAccessor(prefix, lvalue, threshold),   \
-      makeStructFieldAccessor(prefix, lvalue.settings, div), makeStructFieldAccessor(prefix, lvalue.settings, gain),   \
-      makeStructFieldAccessor(prefix, lvalue.settings, ref_current),                                                   \
-      makeStructFieldAccessor(prefix, lvalue.settings, offset),                                                        \
-      makeStructFieldAccessor(prefix, lvalue.settings, count)
-    makeButtonAccessors("config.buttons.OK", config.buttons[0]),
-    makeButtonAccessors("config.buttons.NEXT", config.buttons[1]),
-    makeButtonAccessors("config.buttons.PREVIOUS", config.buttons[2]),
-    makeButtonAccessors("config.buttons.BACK", config.buttons[3]),
-
-    makeAccessor(config.ntp.hostname),
-    makeAccessor(config.ntp.refresh),
-    makeAccessor(config.sdcard.CSPin, validDigitalPin),
+    // the calibration of the current mode, the ones of all modes are in the config schema
+    makeStructFieldAccessorRO("config.scale.calibration", config.scale.getCalibration(), tareRead),
+    makeStructFieldAccessorRO("config.scale.calibration", config.scale.getCalibration(), calibrationRead),
+    makeStructFieldAccessorRO("config.scale.calibration", config.scale.getCalibration(), calibrationWeight),
     valueAccessor()};
 
+constexpr const util::PerfectHash accessorIndex(valueAccessors, &valueAccessor::addressHash);
+static_assert(accessorIndex.unique(), "accessors with the same hash");
+static_assert(accessorIndex.valid());
+
+constexpr bool uniqueHashes() {
+  for (auto accessor = valueAccessors; accessor->get; accessor++)
+    if (eeprom::schema::fieldIndex.find(accessor->addressHash)) return false;
+  return true;
+}
+
+static_assert(uniqueHashes(), "an accessor has the same hash as a config field");
+
 } // namespace
 
 template <bool get> void accessor(WordSplit &args) {
@@ -271,17 +274,21 @@ template <bool get> void accessor(WordSplit &args) {
     return;
   }
   uint32_t addressHash = util::murmur3_32(address);
-  for (auto accessor = valueAccessors; accessor->get || accessor->set; accessor++)
-    if (accessor->addressHash == addressHash) {
-      if (get) {
-        if (accessor->get) accessor->get();
-        else MSerial()->print("get: address cannot be read\n");
-      } else {
-        if (accessor->set) accessor->set(args);
-        else MSerial()->print("set: address cannot be written\n");
-      }
-      return;
+  if (auto field = eeprom::schema::find(addressHash)) {
+    if (get) getField(*field);
+    else setField(*field, args);
+    return;
+  }
+  if (auto accessor = accessorIndex.find(addressHash)) {
+    if (get) {
+      if (accessor->get) accessor->get();
+      else MSerial()->print("get: address cannot be read\n");
+    } else {
+      if (accessor->set) accessor->set(args);
+      else MSerial()->print("set: address cannot be written\n");
     }
+    return;
+  }
   MSerial serial;
   serial->print(prefix);
   serial->print("address not found\n");
@@ -290,4 +297,235 @@ template <bool get> void accessor(WordSplit &args) {
 template void accessor<false>(WordSplit &);
 template void accessor<true>(WordSplit &);
 
+namespace {
+
+/*
+  The multi-line commands config::apply and eeprom::import build a config in the staging buffer, and replace the
+  current one only when the whole input is valid.
+*/
+
+alignas(Config) uint8_t staging[eeprom::maxConfigLength];
+
+struct {
+  // input lines, errors, bytes decoded by eeprom::import
+  uint32_t lines, errors, length;
+  // base64 characters not decoded yet
+  unsigned char pending[4];
+  uint8_t pendingLength;
+} capture;
+
+Config &staged() { return *reinterpret_cast<Config *>(staging); }
+
+// replace the config with the staged one, and save it
+void commitStaged(const char *prefix) {
+  uint32_t changed = 0;
+  bool notify = false;
+  for (auto &field : eeprom::schema::fields)
+    if (!fieldEqual(field, field.in(staged()), field.in(config))) {
+      changed++;
+      notify = notify || field.flags & Field::NOTIFY;
+    }
+  config = staged();
+  if (notify) sinks::configChanged();
+  auto saved = config.save() == eeprom::IOret::OK;
+  MSerial serial;
+  serial->print(prefix);
+  serial->print(saved ? "ok, " : "save error, ");
+  serial->print(changed);
+  serial->print(" fields changed\n");
+}
+
+// the field called name, with or without the "config." prefix
+const Field *findField(const char *name) {
+  if (auto field = eeprom::schema::find(util::murmur3_32(name))) return field;
+  util::StringBuilder<64> prefixed;
+  prefixed += "config.";
+  prefixed += name;
+  return prefixed.overflow() ? nullptr : eeprom::schema::find(util::murmur3_32(prefixed.data()));
+}
+
+void applyError(const char *name, const char *error) {
+  capture.errors++;
+  MSerial serial;
+  serial->print("config::apply: line ");
+  serial->print(capture.lines);
+  serial->print(": ");
+  if (name) {
+    serial->print(name);
+    serial->print(": ");
+  }
+  serial->print(error);
+  serial->print('\n');
+}
+
+bool applyLine(WordSplit *line) {
+  if (!line) return false;
+  capture.lines++;
+  auto str = line->rest(true, true);
+  if (!str || *str == '#') return true;
+  if (!strcmp(str, "end")) {
+    if (!capture.errors) commitStaged("config::apply: ");
+    else {
+      MSerial serial;
+      serial->print("config::apply: ");
+      serial->print(capture.errors);
+      serial->print(" errors, the config is unchanged\n");
+    }
+    return false;
+  }
+  // set name value, or name=value
+  char *name, *value;
+  if (!strncmp(str, "set", 3) && isspace(str[3])) {
+    WordSplit words(str + 4);
+    name = words.nextWord();
+    value = words.str;
+  } else {
+    auto equals = strchr(str, '=');
+    if (!equals) {
+      applyError(nullptr, "expected name=value");
+      return true;
+    }
+    *equals = '\0';
+    name = WordSplit(str).nextWord();
+    for (value = equals + 1; isspace(*value); value++);
+  }
+  auto field = name ? findField(name) : nullptr;
+  if (!field) {
+    applyError(name, "unknown name");
+    return true;
+  }
+  alignas(uint32_t) uint8_t parsed[eeprom::schema::maxFieldSize()];
+  memcpy(parsed, field->in(staged()), field->size);
+  WordSplit args(value);
+  if (auto error = fieldParser(*field, args, parsed)) applyError(name, error);
+  else memcpy(field->in(staged()), parsed, field->size);
+  return true;
+}
+
+bool isBase64(char c) { return isalnum(c) || c == '+' || c == '/' || c == '='; }
+
+bool importLine(WordSplit *line) {
+  if (!line) return false;
+  auto str = line->rest(true, true);
+  if (!str) return true;
+  if (strcmp(str, "end")) {
+    for (; *str && !capture.errors; str++) {
+      if (isspace(*str)) continue;
+      if (!isBase64(*str)) {
+        MSerial()->print("eeprom::import: invalid base64 character\n");
+        capture.errors++;
+        break;
+      }
+      capture.pending[capture.pendingLength++] = *str;
+      if (capture.pendingLength < sizeof(capture.pending)) continue;
+      capture.pendingLength = 0;
+      unsigned char decoded[3];
+      auto length = decode_base64(capture.pending, sizeof(capture.pending), decoded);
+      if (capture.length + length > sizeof(staging)) {
+        MSerial()->print("eeprom::import: too much data\n");
+        capture.errors++;
+        break;
+      }
+      memcpy(staging + capture.length, decoded, length);
+      capture.length += length;
+    }
+    return true;
+  }
+  if (capture.errors || capture.pendingLength) {
+    MSerial()->print("eeprom::import: invalid input, the config is unchanged\n");
+    return false;
+  }
+  switch (staged().convert(staging, capture.length)) {
+  case eeprom::IOret::OK:
+  case eeprom::IOret::UPGRADED: break;
+  case eeprom::IOret::UNKONWN_VERSION: MSerial()->print("eeprom::import: unknown config version\n"); return false;
+  default: MSerial()->print("eeprom::import: not a valid config\n"); return false;
+  }
+  commitStaged("eeprom::import: ");
+  return false;
+}
+
+} // namespace
+
+/*
+  Print the config as `set` commands, that can be pasted back on the command line to restore it.
+*/
+
+void configDump(WordSplit &) {
+  MSerial serial;
+  for (auto &field : eeprom::schema::fields) {
+    serial->print("set ");
+    serial->print(field.name);
+    serial->print(' ');
+    fieldPrinter(*serial, field, field.in(config));
+    serial->print('\n');
+  }
+}
+
+/*
+  Print the fields that differ from the defaults, as input for config::apply.
+*/
+
+void configDiff(WordSplit &) {
+  uint32_t count = 0;
+  MSerial serial;
+  for (auto &field : eeprom::schema::fields) {
+    if (fieldEqual(field, field.in(config), field.in(eeprom::defaultConfig))) continue;
+    count++;
+    serial->print(field.name);
+    serial->print('=');
+    fieldPrinter(*serial, field, field.in(config));
+    serial->print('\n');
+  }
+  serial->print("# ");
+  serial->print(count);
+  serial->print(" fields differ from the defaults\n");
+}
+
+/*
+  Set multiple fields at once: the following lines up to `end` are name=value or `set name value`, as printed by
+  config::diff and config::dump, and names can omit the "config." prefix. Empty lines and lines starting with # are
+  skipped. The fields change and the config is saved only if all the lines are valid.
+*/
+
+void configApply(WordSplit &) {
+  staged() = config;
+  capture = {};
+  captureLines(applyLine);
+  MSerial()->print("config::apply: enter name=value lines, then end\n");
+}
+
+namespace eeprom {
+
+// the config in the DataFlash, in base64 lines of 64 characters
+void export_(WordSplit &) {
+  uint8_t input[48];
+  unsigned char base64[64 + 1];
+  MDataFlash lock;
+  auto &flash = DataFlashBlockDevice::getInstance();
+  auto offset = blastic::eeprom::configOffset();
+  for (uint32_t i = 0; i < blastic::eeprom::maxConfigLength; i += sizeof(input)) {
+    auto length = std::min<uint32_t>(sizeof(input), blastic::eeprom::maxConfigLength - i);
+    if (flash.read(input, offset + i, length)) {
+      MSerial()->print("eeprom::export: read error\n");
+      return;
+    }
+    encode_base64(input, length, base64);
+    MSerial()->println(reinterpret_cast<char *>(base64));
+  }
+}
+
+/*
+  Replace the config with one exported by eeprom::export, possibly by an older firmware: the base64 data follows as
+  arguments and lines up to `end`. The config is converted to the current version, and saved.
+*/
+
+void import(WordSplit &args) {
+  capture = {};
+  if (!importLine(&args)) return;
+  captureLines(importLine);
+}
+
+} // namespace eeprom
+
 } // namespace cli
@@ -4,6 +4,7 @@
 #include "StaticTask.h"
 #include "Mutexed.h"
 #include "utils.h"
+#include "Boot.h"
 
 #if configSUPPORT_STATIC_ALLOCATION == 1
 
@@ -107,7 +108,8 @@ static void _assert_func_freertos(const char *file, int line, const char *failed
   vTaskPrioritySet(nullptr, tskIDLE_PRIORITY + 1);
   while (true) {
     {
-      util::Mutexed<::Serial> serial;
+      util::Mutexed<blastic::boot::console> lock;
+      auto serial = &Serial;
       if (!*serial) serial->begin(BLASTIC_MONITOR_SPEED);
       while (!*serial);
       serial->print("assert: ");
@@ -151,7 +153,9 @@ extern "C" void __assert_func(const char *file, int line, const char *, const ch
 }
 
 void loop() [[noreturn]] {
-  Serial.print("loop: starting FreeRTOS scheduler\n");
+  using namespace blastic::boot;
+  console.print("loop: starting FreeRTOS scheduler\n");
+  mark(Phase::scheduler);
   vTaskStartScheduler();
   assert(false && "vTaskStartScheduler() should never return");
 }
@@ -1,11 +1,19 @@
+#include <algorithm>
 #include <iterator>
 #include <memory>
-#include <base64.hpp>
 #include "DataFlashBlockDevice.h"
 #include "blastic.h"
 #include "SerialCliTask.h"
 #include "Submitter.h"
+#include "Sinks.h"
 #include "utils.h"
+#include "netstats.h"
+#include "DataLog.h"
+#include "Stats.h"
+#include "FlashLog.h"
+#include "WarmState.h"
+#include "Boot.h"
+#include "PerfectHash.h"
 
 namespace blastic {
 
@@ -17,7 +25,7 @@ static Submitter &submitter() {
   return submitter;
 }
 
-using SerialCliTask = cli::SerialCliTask<Serial, 4 * 1024>;
+using SerialCliTask = cli::SerialCliTask<Serial, 4 * 1024, boot::console>;
 static SerialCliTask &cliTask();
 
 namespace buttons {
@@ -34,26 +42,43 @@ void edgeCallback(size_t i, bool rising) {
 void setup() {
   using namespace blastic;
   Serial.begin(BLASTIC_MONITOR_SPEED);
-  while (!Serial);
-  Serial.print("setup: booting blastic-scale version ");
-  Serial.println(version);
+  auto &console = boot::console;
+  console.print("setup: booting blastic-scale version ");
+  console.println(version);
   auto [ioret, configVersion] = config.load();
   switch (ioret) {
-  case eeprom::IOret::UPGRADED: Serial.print("setup: eeprom saved config converted from older version\n");
+  case eeprom::IOret::UPGRADED: console.print("setup: eeprom saved config converted from older version\n");
   case eeprom::IOret::OK:
-    Serial.print("setup: loaded configuration from eeprom version ");
-    Serial.print(configVersion);
-    Serial.println();
+    console.print("setup: loaded configuration from eeprom version ");
+    console.print(configVersion);
+    console.println();
     break;
   default:
     config.defaults();
-    Serial.print("setup: cannot load eeprom data, using defaults\n");
+    console.print("setup: cannot load eeprom data, using defaults\n");
     break;
   }
+  boot::mark(boot::Phase::config);
+  if (warm::begin()) {
+    auto state = warm::get();
+    ntp::restore(state.epoch);
+    console.print("setup: warm boot ");
+    console.print(state.boots);
+    console.print(", time ");
+    console.println(state.epoch);
+  }
+  sinks::configChanged();
+  sinks::dispatcher();
   submitter();
   cliTask();
+  boot::mark(boot::Phase::tasks);
   buttons::reload(config.buttons);
-  Serial.print("setup: done\n");
+  boot::mark(boot::Phase::buttons);
+  // connect and sync the time in the background while the submitter tares
+  ntp::startSync();
+  console.print("setup: done\n");
+  boot::mark(boot::Phase::setup);
+  boot::watchHost();
 }
 
 namespace cli {
@@ -74,6 +99,25 @@ static void uptime(WordSplit &) {
   serial->print("s\n");
 }
 
+namespace boot {
+
+using namespace blastic::boot;
+
+static void times(WordSplit &) {
+  MSerial serial;
+  for (size_t i = 0; i < size_t(Phase::count); i++) {
+    serial->print("boot::times: ");
+    serial->print(phaseNames[i]);
+    serial->print(' ');
+    if (auto millis = time(Phase(i))) {
+      serial->print(millis);
+      serial->print(" ms\n");
+    } else serial->print("pending\n");
+  }
+}
+
+} // namespace boot
+
 static void echo(WordSplit &args) {
   MSerial serial;
   serial->print("echo: ");
@@ -128,6 +172,7 @@ static void tare(WordSplit &) {
   }
   auto &calibration = config.scale.getCalibration();
   calibration.tareRead = value;
+  warm::saveTare(config.scale.mode, value);
   MSerial serial;
   serial->print("scale::tare: set to raw read value ");
   serial->println(value);
@@ -186,16 +231,25 @@ using namespace ::wifi;
 static void status(WordSplit &) {
   uint8_t status;
   util::StringBuffer<12> firmwareVersion;
+  SSLClient::ReadStats readStats;
   {
     MWiFi wifi;
     status = wifi->status();
     firmwareVersion = wifi->firmwareVersion();
+    readStats = SSLClient::readStats;
   }
   MSerial serial;
   serial->print("wifi::status: status ");
   serial->print(status);
   serial->print(" version ");
-  serial->println(firmwareVersion);
+  serial->print(firmwareVersion);
+  serial->print(" tls reads ");
+  serial->print(readStats.count);
+  serial->print(" avg ");
+  serial->print(readStats.count ? (unsigned long)(readStats.totalMicros / readStats.count) : 0ul);
+  serial->print("us max ");
+  serial->print(readStats.maxMicros);
+  serial->print("us\n");
 }
 
 static void connect(WordSplit &) {
@@ -237,6 +291,58 @@ static void connect(WordSplit &) {
   serial->println(dns2);
 }
 
+static void stats(WordSplit &) {
+  using namespace netstats;
+  for (size_t phase = 0; phase < size_t(Phase::count); phase++) {
+    auto summary = netstats::summary(Phase(phase));
+    MSerial serial;
+    serial->print("wifi::stats: ");
+    serial->print(phaseNames[phase]);
+    serial->print(" count ");
+    serial->print(summary.count);
+    if (summary.count) {
+      serial->print(" min ");
+      serial->print(summary.min);
+      serial->print(" avg ");
+      serial->print(summary.avg);
+      serial->print(" p95 ");
+      serial->print(summary.p95);
+      serial->print(" max ");
+      serial->print(summary.max);
+      serial->print(" ms");
+    }
+    serial->println();
+  }
+}
+
+static void networks(WordSplit &) {
+  const char *ssids[Layer3::maxNetworks]{config.wifi.ssid};
+  for (size_t i = 0; i < Layer3::maxAlternates; i++) ssids[i + 1] = config.wifi.alternates[i].ssid;
+  for (size_t i = 0; i < Layer3::maxNetworks; i++) {
+    if (!std::strlen(ssids[i])) continue;
+    auto &stats = Layer3::networkStats[i];
+    MSerial serial;
+    serial->print("wifi::networks: ");
+    serial->print(ssids[i]);
+    serial->print(" rssi ");
+    serial->print(stats.rssi);
+    serial->print(" attempts ");
+    serial->print(stats.attempts);
+    serial->print(" successes ");
+    serial->print(stats.successes);
+    if (stats.successes) {
+      serial->print(" connect avg ");
+      serial->print(stats.totalConnectMillis / stats.successes);
+      serial->print(" max ");
+      serial->print(stats.maxConnectMillis);
+      serial->print(" ms, last success ");
+      serial->print((millis() - stats.lastSuccessMillis) / 1000);
+      serial->print(" s ago");
+    }
+    serial->println();
+  }
+}
+
 constexpr const uint16_t defaultTlsPort = 443;
 
 static void tls(WordSplit &args) {
@@ -311,23 +417,219 @@ static void tls(WordSplit &args) {
   MSerial()->print("\ntls::ping: connection closed\n");
 }
 
+namespace benchClient {
+
+/*
+  Helpers for wifi::bench, which talks to scripts/bench-server.py.
+*/
+
+constexpr const uint32_t timeout = 10000;
+constexpr const size_t chunkSize = 256;
+
+/*
+  Read a '\n' terminated line, without the terminator. The server sends nothing after a reply line until the next
+  command, so whatever is available can be read at once.
+*/
+
+static bool readLine(SSLClient &client, char *line, size_t size) {
+  auto start = millis();
+  for (size_t len = 0; millis() - start < timeout;) {
+    auto available = client.available();
+    if (available <= 0) {
+      if (!client.connected()) return false;
+      vTaskDelay(1);
+      continue;
+    }
+    uint8_t buffer[32];
+    auto read = client.read(buffer, min(size_t(available), sizeof(buffer)));
+    if (read < 0) return false;
+    for (int i = 0; i < read; i++) {
+      if (buffer[i] == '\n') return line[len] = '\0', true;
+      if (len < size - 1) line[len++] = buffer[i];
+    }
+  }
+  return false;
+}
+
+static bool command(SSLClient &client, const char *command, uint32_t bytes, const char *expectedReply) {
+  char line[16];
+  if (!client.print(command) || (bytes && (!client.print(' ') || !client.print(bytes))) || !client.println())
+    return false;
+  return !expectedReply || (readLine(client, line, sizeof(line)) && !strcmp(line, expectedReply));
+}
+
+static bool download(SSLClient &client, uint32_t bytes) {
+  if (!command(client, "DOWN", bytes, nullptr)) return false;
+  uint8_t buffer[chunkSize];
+  auto start = millis();
+  while (bytes && millis() - start < timeout) {
+    auto read = client.read(buffer, min(bytes, sizeof(buffer)));
+    if (read < 0) return false;
+    if (!read) vTaskDelay(1);
+    bytes -= read;
+  }
+  return !bytes;
+}
+
+static bool upload(SSLClient &client, uint32_t bytes) {
+  if (!command(client, "UP", bytes, nullptr)) return false;
+  uint8_t buffer[chunkSize];
+  memset(buffer, 'x', sizeof(buffer));
+  while (bytes) {
+    auto len = min(bytes, sizeof(buffer));
+    if (client.write(buffer, len) != len) return false;
+    bytes -= len;
+  }
+  char line[16];
+  return readLine(client, line, sizeof(line)) && !strcmp(line, "OK");
+}
+
+struct Stat {
+  uint32_t n = 0, min = uint32_t(-1), max = 0, sum = 0;
+  void operator+=(uint32_t v) { n++, sum += v, min = ::min(min, v), max = ::max(max, v); }
+  void print(Print &p, const char *name, const char *unit) const {
+    p.print("wifi::bench: ");
+    p.print(name);
+    if (!n) {
+      p.print(" no samples\n");
+      return;
+    }
+    p.print(" min ");
+    p.print(min);
+    p.print(" avg ");
+    p.print(sum / n);
+    p.print(" max ");
+    p.print(max);
+    p.print(' ');
+    p.println(unit);
+  }
+};
+
+} // namespace benchClient
+
+/*
+  Measure TLS handshake time, request round trip time and download/upload throughput against scripts/bench-server.py.
+*/
+
+static void bench(WordSplit &args) {
+  auto address = args.nextWord();
+  if (!address) {
+    MSerial()->print("wifi::bench: missing address\n");
+    return;
+  }
+  auto parseArg = [&args](uint32_t defaultValue) -> uint32_t {
+    auto str = args.nextWord();
+    if (!str) return defaultValue;
+    char *end;
+    auto value = strtoul(str, &end, 10);
+    return str != end ? value : 0;
+  };
+  auto port = parseArg(defaultTlsPort), bytes = parseArg(64 * 1024), iterations = parseArg(5);
+  if (!port || port > uint16_t(-1) || !bytes || !iterations) {
+    MSerial()->print("wifi::bench: invalid arguments\n");
+    return;
+  }
+  if (!Layer3::firmwareCompatible()) {
+    MSerial()->print("wifi::bench: bad wifi firmware, need at least version " WIFI_FIRMWARE_LATEST_VERSION "\n");
+    return;
+  }
+  Layer3 wifi(config.wifi);
+  if (!wifi) {
+    MSerial()->print("wifi::bench: failed to connect to wifi\n");
+    return;
+  }
+  benchClient::Stat handshake, rtt, down, up;
+  for (uint32_t i = 0; i < iterations; i++) {
+    SSLClient client;
+    auto start = millis();
+    if (!client.connect(address, port)) {
+      MSerial()->print("wifi::bench: failed to connect to server\n");
+      continue;
+    }
+    handshake += millis() - start;
+    start = millis();
+    if (!benchClient::command(client, "PING", 0, "PONG")) goto error;
+    rtt += millis() - start;
+    start = millis();
+    if (!benchClient::download(client, bytes)) goto error;
+    // bytes per millisecond is kB/s
+    down += bytes / max(millis() - start, 1ul);
+    start = millis();
+    if (!benchClient::upload(client, bytes)) goto error;
+    up += bytes / max(millis() - start, 1ul);
+    if (blastic::debug) {
+      MSerial serial;
+      serial->print("wifi::bench: iteration ");
+      serial->print(i);
+      serial->print(" done\n");
+    }
+    continue;
+  error:
+    MSerial serial;
+    serial->print("wifi::bench: iteration ");
+    serial->print(i);
+    serial->print(" failed\n");
+  }
+  MSerial serial;
+  serial->print("wifi::bench: ");
+  serial->print(iterations);
+  serial->print(" iterations, ");
+  serial->print(bytes);
+  serial->print(" bytes\n");
+  handshake.print(*serial, "handshake", "ms");
+  rtt.print(*serial, "rtt", "ms");
+  down.print(*serial, "download", "kB/s");
+  up.print(*serial, "upload", "kB/s");
+}
+
 } // namespace wifi
 
 namespace submit {
 
+static constexpr const util::PerfectHash actionIndex(Submitter::actions,
+                                                     [](auto &action) { return std::get<uint32_t>(action); });
+static_assert(actionIndex.unique(), "actions with the same hash");
+static_assert(actionIndex.valid());
+
 static void action(WordSplit &args) {
   auto actionStr = args.nextWord();
-  if (!actionStr) MSerial()->print("submit::action: missing command argument\n");
-  auto hash = util::murmur3_32(actionStr);
-  for (auto action : Submitter::actions) {
-    if (std::get<uint32_t>(action) != hash) continue;
-    submitter().action(std::get<Submitter::Action>(action));
-    MSerial serial;
-    serial->print("submit::action: sent action ");
-    serial->println(actionStr);
+  if (!actionStr) {
+    MSerial()->print("submit::action: missing command argument\n");
+    return;
+  }
+  auto action = actionIndex.find(util::murmur3_32(actionStr));
+  if (!action) {
+    MSerial()->print("submit::action: action not found\n");
     return;
   }
-  MSerial()->print("submit::action: action not found\n");
+  submitter().action(std::get<Submitter::Action>(*action));
+  MSerial serial;
+  serial->print("submit::action: sent action ");
+  serial->println(actionStr);
+}
+
+/*
+  submit::replay           resume the replay of data.csv and the measurement log from the cursor file
+  submit::replay <epoch>   restart the replay from the beginning, skipping records older than epoch
+  submit::replay stop
+*/
+
+static void replay(WordSplit &args) {
+  auto &dispatcher = sinks::dispatcher();
+  auto arg = args.nextWord();
+  bool queued;
+  if (!arg) queued = dispatcher.resumeReplay();
+  else if (!strcmp(arg, "stop")) queued = dispatcher.stopReplay();
+  else {
+    char *end;
+    auto fromEpoch = strtol(arg, &end, 10);
+    if (end == arg || *end) {
+      MSerial()->print("submit::replay: invalid epoch\n");
+      return;
+    }
+    queued = dispatcher.replay(fromEpoch);
+  }
+  if (!queued) MSerial()->print("submit::replay: dispatcher queue full, retry later\n");
 }
 
 } // namespace submit
@@ -354,25 +656,18 @@ static void save(WordSplit &) {
   } else serial->print("error\n");
 }
 
-static void export_(WordSplit &) {
-  auto inputLen = blastic::eeprom::maxConfigLength, base64Length = (inputLen + 2 - ((inputLen + 2) % 3)) / 3 * 4 + 1;
-  configASSERT(base64Length == encode_base64_length(inputLen) + 1);
-  unsigned char input[inputLen], base64[base64Length];
-  auto &flash = DataFlashBlockDevice::getInstance();
-  if (flash.read(input, 0, inputLen)) {
-    MSerial()->print("eeprom::export: read error\n");
-    return;
-  }
-  encode_base64(input, inputLen, base64);
-  MSerial()->println(reinterpret_cast<char *>(base64));
-}
+// in accessor.cpp
+void export_(WordSplit &);
+void import(WordSplit &);
 
 static void blank(WordSplit &args) {
+  MDataFlash lock;
   auto &flash = DataFlashBlockDevice::getInstance();
-  if (!flash.erase(0, blastic::eeprom::maxConfigLength)) {
+  auto size = blastic::eeprom::configAreaSize();
+  if (!flash.erase(0, size)) {
     MSerial serial;
     serial->print("eeprom::blank: ok ");
-    serial->print(blastic::eeprom::maxConfigLength);
+    serial->print(size);
     serial->print(" bytes\n");
   } else MSerial()->print("eeprom::blank: error\n");
 }
@@ -405,8 +700,434 @@ static void probe(WordSplit &) {
   }
 }
 
+/*
+  Stream log records from position as CSV rows, in the format of the former data.csv. Records are read in chunks, so
+  that neither the SD card nor the serial port are held for long. filter decides for each record whether to print it,
+  skip it, or stop.
+*/
+
+enum class Filter { PRINT, SKIP, STOP };
+
+template <typename FilterFunction>
+static void stream(const char *command, datalog::Position position, FilterFunction &&filter) {
+  using namespace datalog;
+  MSerial()->print("collectionPoint,collectorName,type,epoch,weight\n");
+  Record records[16];
+  SegmentHeader header;
+  uint32_t rows = 0;
+  for (bool stop = false; !stop;) {
+    int n;
+    {
+      SDCard sd(config.sdcard.CSPin);
+      if (!sd) {
+        MSerial serial;
+        serial->print(command);
+        serial->print(": cannot open SD card\n");
+        return;
+      }
+      n = read(sd, position, records, std::size(records), &header);
+    }
+    if (n < 0) break;
+    MSerial serial;
+    for (int i = 0; i < n && !stop; i++) {
+      auto &record = records[i];
+      switch (filter(record)) {
+      case Filter::SKIP: continue;
+      case Filter::STOP: stop = true; continue;
+      case Filter::PRINT: break;
+      }
+      serial->print(header.collectionPoint);
+      serial->print(',');
+      serial->print(header.collectorName);
+      serial->print(',');
+      serial->print(plasticName(record.type));
+      serial->print(',');
+      serial->print(record.epoch);
+      serial->print(',');
+      serial->println(record.weight, 2);
+      rows++;
+    }
+  }
+  MSerial serial;
+  serial->print(command);
+  serial->print(": ");
+  serial->print(rows);
+  serial->print(" rows\n");
+}
+
+static void export_(WordSplit &) {
+  stream("sd::export", {}, [](const datalog::Record &) { return Filter::PRINT; });
+}
+
+/*
+  sd::tail [n]                      the last n records, 10 by default
+*/
+
+static void tail(WordSplit &args) {
+  uint32_t n = 10;
+  if (auto arg = args.nextWord()) {
+    char *end;
+    n = strtoul(arg, &end, 10);
+    if (end == arg || *end) {
+      MSerial()->print("sd::tail: invalid number of records\n");
+      return;
+    }
+  }
+  datalog::Position position;
+  {
+    SDCard sd(config.sdcard.CSPin);
+    if (!sd) {
+      MSerial()->print("sd::tail: cannot open SD card\n");
+      return;
+    }
+    position = datalog::tail(sd, n);
+  }
+  stream("sd::tail", position, [](const datalog::Record &) { return Filter::PRINT; });
+}
+
+/*
+  sd::range <from> <to> [type]      the records with from <= epoch <= to, optionally of a single plastic type
+
+  The start is found with the log index, and the output stops at the first record newer than to.
+*/
+
+static void range(WordSplit &args) {
+  int32_t epochs[2];
+  for (auto &epoch : epochs) {
+    auto arg = args.nextWord();
+    char *end;
+    if (arg) epoch = strtol(arg, &end, 10);
+    if (!arg || end == arg || *end) {
+      MSerial()->print("sd::range: usage sd::range <from> <to> [type]\n");
+      return;
+    }
+  }
+  auto [from, to] = epochs;
+  auto typeName = args.nextWord();
+  plastic type{};
+  if (typeName) {
+    auto found = std::find_if(std::begin(plastics), std::end(plastics),
+                              [typeName](plastic p) { return !strcasecmp(typeName, plasticName(p)); });
+    if (found == std::end(plastics)) {
+      MSerial()->print("sd::range: unknown plastic type\n");
+      return;
+    }
+    type = *found;
+  }
+  datalog::Position position;
+  {
+    SDCard sd(config.sdcard.CSPin);
+    if (!sd) {
+      MSerial()->print("sd::range: cannot open SD card\n");
+      return;
+    }
+    position = datalog::find(sd, from);
+  }
+  stream("sd::range", position, [=](const datalog::Record &record) {
+    if (record.epoch > to) return Filter::STOP;
+    if (record.epoch < from || (typeName && record.type != type)) return Filter::SKIP;
+    return Filter::PRINT;
+  });
+}
+
+/*
+  sd::dump <file> [offset]          stream a file from offset as binary frames, for scripts/sd-dump
+
+  Each frame is a DumpFrame header, the data and a CRC-32 of both, COBS encoded and delimited by zero bytes on both
+  sides: text printed by other tasks between frames ends up in frames of its own, which the receiver discards. The
+  status lines of the command are also followed by a zero byte, so that the receiver sees them immediately. A last
+  frame with no data carries the file size in offset. An interrupted transfer is resumed by running the command again
+  with the offset of the first missing byte. The card is locked only while reading a batch of frames, the serial port
+  only while writing them.
+*/
+
+struct DumpFrame {
+  uint32_t offset;
+  uint16_t sequence, length;
+};
+
+static void dump(WordSplit &args) {
+  constexpr const size_t frameData = 512, batchFrames = 4;
+  auto path = args.nextWord();
+  uint32_t offset = 0;
+  if (auto arg = args.nextWord()) {
+    char *end;
+    offset = strtoul(arg, &end, 10);
+    if (end == arg || *end) path = nullptr;
+  }
+  if (!path) {
+    MSerial()->print("sd::dump: usage sd::dump <file> [offset]\n");
+    return;
+  }
+  // the CLI task stack is small
+  static uint8_t batch[frameData * batchFrames], payload[sizeof(DumpFrame) + frameData + sizeof(uint32_t)],
+      frame[1 + util::cobsEncodedSize(sizeof(payload)) + 1];
+  uint16_t sequence = 0;
+  auto send = [&](Print &p, uint32_t offset, const uint8_t *data, size_t length) {
+    DumpFrame header{offset, sequence++, uint16_t(length)};
+    memcpy(payload, &header, sizeof(header));
+    if (length) memcpy(payload + sizeof(header), data, length);
+    auto crc = util::crc32(payload, sizeof(header) + length);
+    memcpy(payload + sizeof(header) + length, &crc, sizeof(crc));
+    frame[0] = 0;
+    auto encoded = util::cobsEncode(payload, sizeof(header) + length + sizeof(crc), frame + 1);
+    frame[1 + encoded] = 0;
+    p.write(frame, 1 + encoded + 1);
+  };
+
+  File file;
+  uint32_t size, generation;
+  {
+    SDCard sd(config.sdcard.CSPin);
+    if (!sd) {
+      MSerial serial;
+      serial->print("sd::dump: cannot open SD card\n");
+      serial->write(uint8_t(0));
+      return;
+    }
+    file = sd->open(path, O_READ);
+    if (!file || file.isDirectory()) {
+      file.close();
+      MSerial serial;
+      serial->print("sd::dump: cannot open ");
+      serial->println(path);
+      serial->write(uint8_t(0));
+      return;
+    }
+    size = file.size();
+    generation = SDCard::generation();
+  }
+  offset = std::min(offset, size);
+  {
+    MSerial serial;
+    serial->print("sd::dump: ");
+    serial->print(path);
+    serial->print(' ');
+    serial->print(size);
+    serial->print(" bytes from ");
+    serial->println(offset);
+    serial->write(uint8_t(0));
+  }
+  while (offset < size) {
+    int n;
+    {
+      SDCard sd(config.sdcard.CSPin);
+      // a remount invalidates the file
+      if (!sd || SDCard::generation() != generation || !file.seek(offset)) break;
+      n = file.read(batch, std::min<size_t>(sizeof(batch), size - offset));
+    }
+    if (n <= 0) break;
+    MSerial serial;
+    for (size_t sent = 0; sent < size_t(n); sent += frameData)
+      send(*serial, offset + sent, batch + sent, std::min(frameData, n - sent));
+    offset += n;
+  }
+  {
+    SDCard sd(config.sdcard.CSPin);
+    file.close();
+  }
+  MSerial serial;
+  if (offset < size) {
+    serial->print("sd::dump: error at offset ");
+    serial->println(offset);
+    serial->write(uint8_t(0));
+    return;
+  }
+  send(*serial, size, nullptr, 0);
+  serial->print("sd::dump: done\n");
+}
+
 } // namespace sd
 
+/*
+  stats                 totals per plastic type, and today's (UTC)
+  stats <epoch>         the day of epoch, if it is one of the last stats::dayWindow days
+  stats collectors      totals of the most recent collectors
+  stats rebuild         recompute all the stats from the measurement log
+*/
+
+static void printAggregates(Print &p, const blastic::stats::TypeAggregates &types) {
+  for (size_t i = 0; i < std::size(plastics); i++) {
+    auto &aggregate = types[i];
+    if (!aggregate.count) continue;
+    p.print("  ");
+    p.print(plasticName(plastics[i]));
+    p.print(" count ");
+    p.print(aggregate.count);
+    p.print(" sum ");
+    p.print(aggregate.sum, 2);
+    p.print(" min ");
+    p.print(aggregate.min, 2);
+    p.print(" max ");
+    p.println(aggregate.max, 2);
+  }
+}
+
+static void rebuildStats() {
+  using namespace datalog;
+  {
+    SDCard sd(config.sdcard.CSPin);
+    if (!sd || !stats::reset(sd)) {
+      MSerial()->print("stats: cannot reset the stats\n");
+      return;
+    }
+  }
+  Position position{};
+  Record records[16];
+  SegmentHeader header;
+  uint32_t rows = 0;
+  while (true) {
+    SDCard sd(config.sdcard.CSPin);
+    if (!sd) {
+      MSerial()->print("stats: cannot open SD card\n");
+      return;
+    }
+    auto n = read(sd, position, records, std::size(records), &header);
+    if (n < 0) break;
+    rows += n;
+    for (int i = 0; i < n; i++)
+      if (!stats::add(sd, records[i].epoch, records[i].weight, records[i].type, header.collectionPoint,
+                      header.collectorName)) {
+        MSerial()->print("stats: cannot update the stats\n");
+        return;
+      }
+  }
+  MSerial serial;
+  serial->print("stats: rebuilt from ");
+  serial->print(rows);
+  serial->print(" records\n");
+}
+
+static void stats_(WordSplit &args) {
+  auto arg = args.nextWord();
+  if (arg && !strcmp(arg, "rebuild")) return rebuildStats();
+  SDCard sd(config.sdcard.CSPin);
+  if (!sd) {
+    MSerial()->print("stats: cannot open SD card\n");
+    return;
+  }
+  stats::TypeAggregates types;
+  MSerial serial;
+  if (arg && !strcmp(arg, "collectors")) {
+    auto collector = std::make_unique<stats::Collector>();
+    for (size_t slot = 0; slot < stats::collectorSlots; slot++) {
+      if (!stats::collector(sd, slot, *collector)) {
+        serial->print("stats: read error\n");
+        return;
+      }
+      if (!collector->collector) continue;
+      serial->print("stats: collector ");
+      serial->print(collector->collectionPoint);
+      serial->print(" / ");
+      serial->print(collector->collectorName);
+      serial->print(", last epoch ");
+      serial->println(collector->lastEpoch);
+      printAggregates(*serial, collector->types);
+    }
+    return;
+  }
+  int32_t epoch = ::ntp::unixTime();
+  if (arg) {
+    char *end;
+    epoch = strtol(arg, &end, 10);
+    if (end == arg || *end) {
+      serial->print("stats: usage stats [<epoch>|collectors|rebuild]\n");
+      return;
+    }
+  } else {
+    if (!stats::totals(sd, types)) {
+      serial->print("stats: read error\n");
+      return;
+    }
+    serial->print("stats: totals\n");
+    printAggregates(*serial, types);
+  }
+  if (!epoch) {
+    serial->print("stats: time unset\n");
+    return;
+  }
+  serial->print("stats: day of epoch ");
+  serial->println(epoch);
+  if (stats::day(sd, epoch, types)) printAggregates(*serial, types);
+  else serial->print("  no measurements, or older than the stats window\n");
+}
+
+namespace flash {
+
+/*
+  Fallback measurement log in the DataFlash, see FlashLog.h.
+
+  flash::status       ring size, and number of records in it
+  flash::log          the records in the ring as CSV, oldest first
+  flash::migrate      move the pending records to the SD card now, instead of at the next measurement
+  flash::clear        erase the ring, pending records included
+*/
+
+static void status(WordSplit &) {
+  auto status = flashlog::status();
+  MSerial serial;
+  serial->print("flash::status: ");
+  serial->print(status.blocks);
+  serial->print(" blocks, ");
+  serial->print(status.records);
+  serial->print('/');
+  serial->print(status.capacity);
+  serial->print(" records, ");
+  serial->print(status.pending);
+  serial->print(" pending, ");
+  serial->print(status.lost);
+  serial->print(" lost since boot\n");
+}
+
+static void log(WordSplit &) {
+  MSerial()->print("sequence,type,epoch,weight\n");
+  flashlog::Record records[16];
+  uint32_t position = 0, rows = 0;
+  for (int n; (n = flashlog::read(position, records, std::size(records))) >= 0;) {
+    MSerial serial;
+    for (int i = 0; i < n; i++) {
+      auto &record = records[i];
+      serial->print(record.sequence);
+      serial->print(',');
+      serial->print(plasticName(record.type));
+      serial->print(',');
+      serial->print(record.flags & flashlog::Record::TIME_UNSET ? 0 : record.epoch);
+      serial->print(',');
+      serial->println(record.weight, 2);
+    }
+    rows += n;
+  }
+  MSerial serial;
+  serial->print("flash::log: ");
+  serial->print(rows);
+  serial->print(" rows\n");
+}
+
+static void migrate(WordSplit &) {
+  int moved;
+  {
+    SDCard sd(config.sdcard.CSPin);
+    if (!sd) {
+      MSerial()->print("flash::migrate: cannot open SD card\n");
+      return;
+    }
+    moved = flashlog::migrate(sd);
+  }
+  MSerial serial;
+  if (moved < 0) serial->print("flash::migrate: error\n");
+  else {
+    serial->print("flash::migrate: moved ");
+    serial->print(moved);
+    serial->print(" records\n");
+  }
+}
+
+static void clear(WordSplit &) {
+  MSerial()->print(flashlog::clear() ? "flash::clear: ok\n" : "flash::clear: error\n");
+}
+
+} // namespace flash
+
 namespace ntp {
 
 static void epoch(WordSplit &) {
@@ -436,11 +1157,18 @@ static void sync(WordSplit &) {
 } // namespace ntp
 
 template <bool get> void accessor(WordSplit &args);
+void configDump(WordSplit &);
+void configDiff(WordSplit &);
+void configApply(WordSplit &);
 
 static constexpr const CliCallback callbacks[]{makeCliCallback(uptime),
                                                makeCliCallback(echo),
+                                               makeCliCallback(boot::times),
                                                CliCallback("get", accessor<true>),
                                                CliCallback("set", accessor<false>),
+                                               CliCallback("config::dump", configDump),
+                                               CliCallback("config::diff", configDiff),
+                                               CliCallback("config::apply", configApply),
 #if (configUSE_TRACE_FACILITY == 1)
                                                makeCliCallback(tasks),
 #endif
@@ -451,23 +1179,41 @@ static constexpr const CliCallback callbacks[]{makeCliCallback(uptime),
                                                makeCliCallback(scale::weight),
                                                makeCliCallback(wifi::status),
                                                makeCliCallback(wifi::connect),
+                                               makeCliCallback(wifi::stats),
+                                               makeCliCallback(wifi::networks),
                                                makeCliCallback(wifi::tls),
+                                               makeCliCallback(wifi::bench),
                                                makeCliCallback(submit::action),
+                                               makeCliCallback(submit::replay),
                                                makeCliCallback(buttons::reload),
                                                makeCliCallback(eeprom::save),
                                                CliCallback("eeprom::export", eeprom::export_),
+                                               makeCliCallback(eeprom::import),
                                                makeCliCallback(eeprom::blank),
                                                makeCliCallback(sd::probe),
+                                               CliCallback("sd::export", sd::export_),
+                                               makeCliCallback(sd::tail),
+                                               makeCliCallback(sd::range),
+                                               makeCliCallback(sd::dump),
+                                               CliCallback("stats", stats_),
+                                               makeCliCallback(flash::status),
+                                               makeCliCallback(flash::log),
+                                               makeCliCallback(flash::migrate),
+                                               makeCliCallback(flash::clear),
                                                makeCliCallback(ntp::epoch),
                                                makeCliCallback(ntp::sync),
                                                CliCallback()};
 
+static constexpr const util::PerfectHash callbackIndex(callbacks, &CliCallback::hash);
+static_assert(callbackIndex.unique(), "CLI commands with the same hash");
+static_assert(callbackIndex.valid());
+
 } // namespace cli
 
 namespace blastic {
 
 static SerialCliTask &cliTask() {
-  static SerialCliTask cliTask(cli::callbacks);
+  static SerialCliTask cliTask([](uint32_t commandHash) { return cli::callbackIndex.find(commandHash); });
   return cliTask;
 }
 
@@ -0,0 +1,59 @@
+#include <algorithm>
+#include "netstats.h"
+#include "Mutexed.h"
+
+namespace netstats {
+
+bool logToSD = false;
+
+namespace {
+
+struct PhaseSamples {
+  uint16_t samples[window];
+  uint32_t count, lastSubmission;
+};
+
+PhaseSamples phases[size_t(Phase::count)];
+
+} // namespace
+
+void record(Phase phase, uint32_t millis) {
+  util::Mutexed<phases> lockedPhases;
+  auto &samples = (*lockedPhases)[size_t(phase)];
+  // saturate to the sample type, anything this long is a timeout anyway
+  samples.samples[samples.count++ % window] = std::min(millis, uint32_t(uint16_t(-1)));
+  samples.lastSubmission = millis;
+}
+
+Summary summary(Phase phase) {
+  uint16_t sorted[window];
+  size_t n;
+  Summary summary{};
+  {
+    util::Mutexed<phases> lockedPhases;
+    auto &samples = (*lockedPhases)[size_t(phase)];
+    summary.count = samples.count;
+    n = std::min<size_t>(samples.count, window);
+    std::copy(samples.samples, samples.samples + n, sorted);
+  }
+  if (!n) return summary;
+  std::sort(sorted, sorted + n);
+  uint32_t sum = 0;
+  for (auto sample = sorted; sample < sorted + n; sample++) sum += *sample;
+  summary.min = sorted[0], summary.max = sorted[n - 1], summary.avg = sum / n;
+  // nearest-rank percentile
+  summary.p95 = sorted[(95 * n + 99) / 100 - 1];
+  return summary;
+}
+
+void beginSubmission() {
+  util::Mutexed<phases> lockedPhases;
+  for (auto &samples : *lockedPhases) samples.lastSubmission = 0;
+}
+
+uint32_t lastSubmission(Phase phase) {
+  util::Mutexed<phases> lockedPhases;
+  return (*lockedPhases)[size_t(phase)].lastSubmission;
+}
+
+} // namespace netstats
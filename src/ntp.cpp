@@ -1,6 +1,8 @@
 #include <memory>
 #include "ntp.h"
 #include "blastic.h"
+#include "netstats.h"
+#include "Boot.h"
 #include <NTPClient.h>
 
 namespace {
@@ -15,12 +17,59 @@ int updateRealTimeSeconds() {
   return *lockedRTS;
 }
 
+// days since 1970-01-01 of a proleptic Gregorian date, see http://howardhinnant.github.io/date_algorithms.html
+int daysFromCivil(int y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  int era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = y - era * 400;
+  unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + int(doe) - 719468;
+}
+
 } // namespace
 
 namespace ntp {
 
 int unixTime() { return offsetToUnixTime ? updateRealTimeSeconds() + offsetToUnixTime : 0; }
 
+void restore(int epoch) {
+  if (!epoch || unixTime()) return;
+  offsetToUnixTime = epoch - updateRealTimeSeconds();
+}
+
+bool stale() {
+  using namespace blastic;
+  auto now = unixTime();
+  return !now || !config.ntp.refresh || now - lastSyncEpoch >= config.ntp.refresh;
+}
+
+bool syncFromHttpDate(const char *date) {
+  // Sun, 06 Nov 1994 08:49:37 GMT
+  constexpr const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  auto comma = strchr(date, ',');
+  if (!comma) return false;
+  int day, year, hour, minute, second;
+  char month[4];
+  if (sscanf(comma + 1, " %d %3s %d %d:%d:%d GMT", &day, month, &year, &hour, &minute, &second) != 6) return false;
+  auto monthPos = strstr(months, month);
+  if (strlen(month) != 3 || !monthPos || (monthPos - months) % 3 || day < 1 || day > 31 || year < 2024 ||
+      hour > 23 || minute > 59 || second > 60)
+    return false;
+  if (!stale()) return true;
+  auto epoch = daysFromCivil(year, (monthPos - months) / 3 + 1, day) * 24 * 60 * 60 + hour * 60 * 60 + minute * 60 +
+               second;
+  auto previous = unixTime();
+  lastSyncEpoch = epoch;
+  offsetToUnixTime = epoch - updateRealTimeSeconds();
+  if (blastic::debug || !previous) {
+    blastic::MSerial serial;
+    serial->print("ntpsync: synced from http date at ");
+    serial->println(epoch);
+  }
+  return true;
+}
+
 void startSync(bool force) {
   using namespace blastic;
   // call updateRealTimeSeconds() every day to avoid millis() overflow issues
@@ -31,29 +80,34 @@ void startSync(bool force) {
   configASSERT(xTimerStart(rtcTimer, portMAX_DELAY));
   auto now = unixTime();
   if (!strlen(config.ntp.hostname) || (!force && config.ntp.refresh && now && now - lastSyncEpoch < config.ntp.refresh))
-    return;
+    return boot::done(boot::Job::time);
   using namespace wifi;
   Layer3::background().set(
       [hostname = String(config.ntp.hostname)](uint32_t) {
         Layer3 wifi;
         if (!wifi) {
           MSerial()->print("ntpsync: no wifi connection\n");
+          boot::done(boot::Job::time);
           return portMAX_DELAY;
         }
         auto udp = std::make_unique<WiFiUDP>();
         auto ntp = std::make_unique<NTPClient>(*udp, hostname.c_str());
+        netstats::Stopwatch stopwatch;
         ntp->begin();
         ntp->forceUpdate();
         ntp->end();
         if (!ntp->isTimeSet()) {
           MSerial()->print("ntpsync: failed to sync\n");
+          boot::done(boot::Job::time);
           return portMAX_DELAY;
         }
+        stopwatch.lap(netstats::Phase::ntp);
         lastSyncEpoch = ntp->getEpochTime();
         offsetToUnixTime = lastSyncEpoch - updateRealTimeSeconds();
         MSerial serial;
         serial->print("ntpsync: synced at ");
         serial->println(lastSyncEpoch);
+        boot::done(boot::Job::time);
         return portMAX_DELAY;
       },
       force ? portMAX_DELAY : 0);
@@ -1,154 +1,303 @@
 #include <utility>
-#include <variant>
-#include <memory>
+#include <algorithm>
 #include "DataFlashBlockDevice.h"
 #include "blastic.h"
+#include "ConfigSchema.h"
 #include "murmur32.h"
 
 namespace blastic {
 
 namespace eeprom {
 
-// when upgrading the currentVersion, add the relevant code in operator= (as `if constexpr` dependent on versionFrom),
-// defaults() and sanitize().
+// when upgrading the currentVersion, list the new fields in BLASTIC_CONFIG_SCHEMA with their minVersion, and set their
+// defaults in makeDefaults(). Fields that change type or meaning need code in operator= (as `if constexpr` dependent
+// on versionFrom).
 
 template <uint32_t version>
 template <uint32_t versionFrom>
 Config<version> &Config<version>::operator=(const Config<versionFrom> &o) {
-  scale = o.scale;
-  wifi = o.wifi;
-  submit.threshold = o.submit.threshold;
-  if constexpr (versionFrom >= 4) submit.skipPPForm = o.submit.skipPPForm;
-  if constexpr (versionFrom >= 5) submit.spacesWorkaroundPPForm = o.submit.spacesWorkaroundPPForm;
-  submit.collectionPoint = o.submit.collectionPoint;
-  submit.collectorName = o.submit.collectorName;
-  submit.userForm = submit.userForm;
-  buttons = o.buttons;
-  if constexpr (versionFrom >= 1) sdcard = o.sdcard;
-  if constexpr (versionFrom >= 2) ntp.hostname = o.ntp.hostname;
-  if constexpr (versionFrom >= 3) ntp.refresh = o.ntp.refresh;
+#define BLASTIC_CONFIG_CONVERT_FIELD(name, path, minVersion, ...)                                                      \
+  if constexpr (versionFrom >= minVersion) path = o.path;
+#define BLASTIC_CONFIG_CONVERT_ELEMENT(name, array, index, path, minVersion, ...)                                      \
+  if constexpr (versionFrom >= minVersion) array[index].path = o.array[index].path;
+  BLASTIC_CONFIG_SCHEMA(BLASTIC_CONFIG_CONVERT_FIELD, BLASTIC_CONFIG_CONVERT_ELEMENT)
+#undef BLASTIC_CONFIG_CONVERT_FIELD
+#undef BLASTIC_CONFIG_CONVERT_ELEMENT
   return *this;
 }
 
-template <> void Config<currentVersion>::defaults() {
-  memset(this, 0, sizeof(*this));
-  header = {.signature = Header::expectedSignature, .Version = currentVersion};
-  scale = {.dataPin = 5, .clockPin = 4, .mode = scale::HX711Mode::A128};
-  for (auto &cal : scale.calibrations) cal.calibrationWeight = util::AnnotatedFloat("unc");
-  wifi.dhcpTimeout = wifi.idleTimeout = 10;
-  submit.threshold = 0.05;
-  submit.skipPPForm = submit.spacesWorkaroundPPForm = true;
-  submit.collectionPoint = "BlastPersis";
-  submit.collectorName = "BSPers";
+namespace {
+
+// StringBuffer::operator= is not constexpr
+template <size_t size> constexpr void setString(util::StringBuffer<size> &dst, const char *src) {
+  for (size_t i = 0; i < size - 1 && src[i]; i++) dst[i] = src[i];
+}
+
+/*
+  The defaults are computed at compile time, and live in flash as defaultConfig.
+*/
+
+constexpr Config<currentVersion> makeDefaults() {
+  Config<currentVersion> config{};
+  config.header = {.signature = Config<currentVersion>::Header::expectedSignature, .Version = currentVersion};
+  config.scale = {.dataPin = 5, .clockPin = 4, .mode = scale::HX711Mode::A128};
+  for (auto &cal : config.scale.calibrations) cal.calibrationWeight = util::AnnotatedFloat("unc");
+  config.wifi.dhcpTimeout = config.wifi.idleTimeout = 10;
+  config.submit.threshold = 0.05;
+  config.submit.skipPPForm = config.submit.spacesWorkaroundPPForm = true;
+  setString(config.submit.collectionPoint, "BlastPersis");
+  setString(config.submit.collectorName, "BSPers");
+  config.submit.mqtt.port = 8883;
   // OK
-  buttons[0] = {
+  config.buttons[0] = {
       .pin = 3,
       .threshold = 5234,
       .settings = {.div = CTSU_CLOCK_DIV_18, .gain = CTSU_ICO_GAIN_100, .ref_current = 0, .offset = 157, .count = 1}};
   // NEXT
-  buttons[1] = {
+  config.buttons[1] = {
       .pin = 6,
       .threshold = 3698,
       .settings = {.div = CTSU_CLOCK_DIV_18, .gain = CTSU_ICO_GAIN_100, .ref_current = 0, .offset = 237, .count = 1}};
   // PREVIOUS
-  buttons[2] = {
+  config.buttons[2] = {
       .pin = 8,
       .threshold = 2967,
       .settings = {.div = CTSU_CLOCK_DIV_18, .gain = CTSU_ICO_GAIN_100, .ref_current = 0, .offset = 178, .count = 1}};
   // BACK
-  buttons[3] = {
+  config.buttons[3] = {
       .pin = 9,
       .threshold = 4513,
       .settings = {.div = CTSU_CLOCK_DIV_18, .gain = CTSU_ICO_GAIN_100, .ref_current = 0, .offset = 186, .count = 1}};
-  sdcard.CSPin = 10;
-  ntp.hostname = "europe.pool.ntp.org";
-  ntp.refresh = 24 * 60 * 60;
-};
+  config.sdcard.CSPin = 10;
+  config.sdcard.syncRecords = 1;
+  config.sdcard.syncSeconds = 10;
+  setString(config.ntp.hostname, "europe.pool.ntp.org");
+  config.ntp.refresh = 24 * 60 * 60;
+  return config;
+}
+
+} // namespace
+
+constexpr const Config<currentVersion> defaultConfig = makeDefaults();
+
+template <> void Config<currentVersion>::defaults() { *this = defaultConfig; }
+
+namespace schema {
 
 namespace {
 
-void sanitizeStringBuffers() {}
-template <size_t size, typename... Rest>
-inline void sanitizeStringBuffers(util::StringBuffer<size> &str, Rest &&...rest) {
-  *(str.rbegin()) = '\0';
-  sanitizeStringBuffers(std::forward<Rest>(rest)...);
+// an integer or enum field, zero extended
+uint32_t integer(const Field &field, const void *value) {
+  uint32_t integer = 0;
+  memcpy(&integer, value, std::min<size_t>(field.size, sizeof(integer)));
+  return integer;
 }
 
 } // namespace
 
-template <> void Config<currentVersion>::sanitize() {
-  auto defaults = std::make_unique<Config<currentVersion>>();
-  defaults->defaults();
-  // weak sanitization, just make sure we don't get UB (enums out of range, strings without terminators...)
-  if (uint8_t(scale.mode) > uint8_t(scale::HX711Mode::A64)) scale.mode = defaults->scale.mode;
-  if (!isfinite(submit.threshold) || submit.threshold < 0) submit.threshold = defaults->submit.threshold;
-  for (int i = 0; i < size(buttons); i++) {
-    auto &defaultButton = defaults->buttons[i], &button = buttons[i];
-    if (uint32_t(button.settings.div) > uint32_t(CTSU_CLOCK_DIV_64)) button.settings.div = defaultButton.settings.div;
-    if (uint32_t(button.settings.gain) > uint32_t(CTSU_ICO_GAIN_40)) button.settings.gain = defaultButton.settings.gain;
+bool validate(const Field &field, void *value) {
+  switch (field.type) {
+  case FieldType::BOOL: return integer(field, value) <= 1;
+  case FieldType::FLOAT: {
+    auto &f = *static_cast<float *>(value);
+    return isfinite(f) && (field.validator != Field::POSITIVE || (f = fabsf(f)) > 0);
+  }
+  case FieldType::ANNOTATED_FLOAT: return true;
+  case FieldType::STRING: static_cast<char *>(value)[field.size - 1] = '\0'; return true;
+  case FieldType::HX711_MODE: return integer(field, value) <= uint32_t(scale::HX711Mode::A64);
+  case FieldType::CTSU_GAIN: return integer(field, value) <= uint32_t(CTSU_ICO_GAIN_40);
+  case FieldType::CTSU_DIV: return integer(field, value) <= uint32_t(CTSU_CLOCK_DIV_64);
+  default: break;
+  }
+  switch (field.validator) {
+  case Field::DIGITAL_PIN: return integer(field, value) <= 13;
+  case Field::NONZERO: return integer(field, value) != 0;
+  default: return true;
   }
-  sanitizeStringBuffers(wifi.ssid, wifi.password, submit.collectionPoint, submit.collectorName,
-                        submit.userForm.collectionPoint, submit.userForm.collectorName, submit.userForm.type,
-                        submit.userForm.urn, submit.userForm.weight, ntp.hostname);
+}
+
+} // namespace schema
+
+template <> void Config<currentVersion>::sanitize() {
+  // weak sanitization, just make sure we don't get UB (enums out of range, strings without terminators...), and reset
+  // the fields that the setters would reject
+  for (auto &field : schema::fields)
+    if (!schema::validate(field, field.in(*this))) memcpy(field.in(*this), field.in(defaultConfig), field.size);
 }
 
 // leave alone the implementation bits below, they do not need to change across Config version updates
 
 namespace {
 
-template <uint32_t... versions> auto makeConfigVariant(std::integer_sequence<uint32_t, versions...>) {
-  return std::variant<Config<versions>...>{};
+/*
+  Read the config of version eepromVersion with read(dst, length), and convert it to the current version. The current
+  version is read in place, an older one in a stack buffer of its own size, only on the first boot after a firmware
+  upgrade.
+*/
+
+template <uint32_t version, typename Read>
+[[gnu::noinline]] bool readConverting(Config<currentVersion> &config, Read &read) {
+  static_assert(std::is_pod_v<Config<version>>);
+  Config<version> eepromConfig;
+  if (!read(&eepromConfig, sizeof(eepromConfig))) return false;
+  config.defaults();
+  config = eepromConfig;
+  return true;
 }
 
-using ConfigVariant = decltype(makeConfigVariant(std::make_integer_sequence<uint32_t, currentVersion + 1>{}));
+template <typename Read, uint32_t... versions>
+bool readConfig(Config<currentVersion> &config, uint32_t eepromVersion, Read &&read,
+                std::integer_sequence<uint32_t, versions...>) {
+  static_assert(std::is_pod_v<Config<currentVersion>>);
+  if (eepromVersion == currentVersion) return read(&config, sizeof(config));
+  bool ok = false;
+  ((versions == eepromVersion && (ok = readConverting<versions>(config, read))) || ...);
+  return ok;
+}
 
-template <uint32_t version = currentVersion>
-std::unique_ptr<ConfigVariant> readEepromConfigVariant(uint32_t eepromVersion) {
-  if (version == eepromVersion) {
-    static_assert(std::is_pod_v<Config<version>>);
-    auto variant = std::make_unique<ConfigVariant>();
-    auto &config = variant->emplace<Config<version>>();
-    auto &flash = DataFlashBlockDevice::getInstance();
-    if (flash.read(&config, 0, sizeof(config))) goto error;
-    return variant;
-  }
-  if constexpr (version > 0) return readEepromConfigVariant<version - 1>(eepromVersion);
-error:
-  return {};
+static_assert(maxConfigLength <= FLASH_TOTAL_SIZE);
+
+} // namespace
+
+/*
+  The config is saved alternately in two slots, each a SlotHeader followed by the config bytes. A save goes to the slot
+  not in use: its first block is erased, invalidating the header, then the other blocks are rewritten only if their
+  content differs, and the header with the next sequence number is programmed last. A reset during a save leaves the
+  previous slot as the valid one. Loading picks the slot with the newest valid header, and checks the CRC of its data
+  only. A config saved by older firmware, at offset 0 without a SlotHeader, is loaded if no slot is valid.
+*/
+
+namespace {
+
+struct SlotHeader {
+  static constexpr const uint32_t expectedSignature = ((uint32_t('B') << 8 | 'L') << 8 | 'S') << 8 | 'A';
+  uint32_t signature, sequence, length, crc, headerCrc;
+
+  uint32_t checksum() const { return util::crc32(this, offsetof(SlotHeader, headerCrc)); }
+};
+
+uint32_t slotSize() {
+  auto eraseSize = DataFlashBlockDevice::getInstance().get_erase_size();
+  return (sizeof(SlotHeader) + maxConfigLength + eraseSize - 1) / eraseSize * eraseSize;
+}
+
+// two slots, with the 1 KiB erase blocks of the RA4M1 DataFlash
+static_assert(2 * (sizeof(SlotHeader) + maxConfigLength + 1023) / 1024 * 1024 <= FLASH_TOTAL_SIZE);
+
+bool readSlotHeader(uint32_t slot, SlotHeader &header) {
+  return !DataFlashBlockDevice::getInstance().read(&header, slot * slotSize(), sizeof(header)) &&
+         header.signature == SlotHeader::expectedSignature && header.headerCrc == header.checksum() &&
+         header.length <= maxConfigLength;
 }
 
-template <uint32_t version = currentVersion> constexpr size_t getMaxConfigLength(size_t max = 0) {
-  constexpr const size_t size = sizeof(Config<version>);
-  size_t newMax = max > size ? max : size;
-  if constexpr (!version) return newMax;
-  else return getMaxConfigLength<version - 1>(newMax);
+bool slotDataValid(uint32_t slot, const SlotHeader &header) {
+  auto &flash = DataFlashBlockDevice::getInstance();
+  uint8_t chunk[64];
+  uint32_t crc = 0;
+  for (uint32_t offset = 0; offset < header.length; offset += sizeof(chunk)) {
+    auto length = std::min<uint32_t>(sizeof(chunk), header.length - offset);
+    if (flash.read(chunk, slot * slotSize() + sizeof(SlotHeader) + offset, length)) return false;
+    crc = util::crc32(chunk, length, crc);
+  }
+  return crc == header.crc;
 }
 
-static_assert(getMaxConfigLength() <= FLASH_TOTAL_SIZE);
+// the slot of the current config, -1 if none
+int activeSlot(SlotHeader &header) {
+  SlotHeader headers[2];
+  bool valid[2];
+  for (uint32_t slot = 0; slot < 2; slot++) valid[slot] = readSlotHeader(slot, headers[slot]);
+  // the newest first, with wrap around of the sequence numbers
+  uint32_t first = valid[1] && (!valid[0] || int32_t(headers[1].sequence - headers[0].sequence) > 0);
+  for (auto slot : {first, 1 - first}) {
+    if (!valid[slot] || !slotDataValid(slot, headers[slot])) continue;
+    header = headers[slot];
+    return slot;
+  }
+  return -1;
+}
 
 } // namespace
 
-const uint32_t maxConfigLength = getMaxConfigLength();
+uint32_t configAreaSize() { return 2 * slotSize(); }
+
+uint32_t configOffset() {
+  SlotHeader header;
+  auto slot = activeSlot(header);
+  return slot < 0 ? 0 : slot * slotSize() + sizeof(SlotHeader);
+}
 
 template <uint32_t version> std::tuple<IOret, uint32_t> Config<version>::load() {
   auto ret = std::make_tuple(IOret::ERROR, uint32_t(0));
+  MDataFlash lock;
   auto &flash = DataFlashBlockDevice::getInstance();
+  auto offset = configOffset();
   Header eepromHeader;
-  if (flash.read(&eepromHeader, 0, sizeof(eepromHeader)) != FSP_SUCCESS) return ret;
+  if (flash.read(&eepromHeader, offset, sizeof(eepromHeader)) != FSP_SUCCESS) return ret;
   if (eepromHeader.signature != Header::expectedSignature) return std::get<0>(ret) = IOret::NOT_FOUND, ret;
   std::get<1>(ret) = eepromHeader.Version;
   if (eepromHeader.Version > version) return std::get<0>(ret) = IOret::UNKONWN_VERSION, ret;
-  auto configVariant = readEepromConfigVariant(eepromHeader.Version);
-  if (configVariant->valueless_by_exception()) return ret;
-  defaults();
-  std::visit([this](auto &&eepromConfig) { *this = eepromConfig; }, *configVariant);
+  auto read = [&](void *dst, size_t length) { return !flash.read(dst, offset, length); };
+  if (!readConfig(*this, eepromHeader.Version, read, std::make_integer_sequence<uint32_t, currentVersion>{}))
+    return ret;
   sanitize();
   return (std::get<0>(ret) = eepromHeader.Version < version ? IOret::UPGRADED : IOret::OK), ret;
 }
 
+template <uint32_t version> IOret Config<version>::convert(const void *data, size_t length) {
+  Header header;
+  if (length < sizeof(header)) return IOret::NOT_FOUND;
+  memcpy(&header, data, sizeof(header));
+  if (header.signature != Header::expectedSignature) return IOret::NOT_FOUND;
+  if (header.Version > version) return IOret::UNKONWN_VERSION;
+  auto read = [&](void *dst, size_t dstLength) {
+    if (dstLength > length) return false;
+    memmove(dst, data, dstLength);
+    return true;
+  };
+  if (!readConfig(*this, header.Version, read, std::make_integer_sequence<uint32_t, currentVersion>{}))
+    return IOret::ERROR;
+  sanitize();
+  return header.Version < version ? IOret::UPGRADED : IOret::OK;
+}
+
 template <uint32_t version> IOret Config<version>::save() const {
+  MDataFlash lock;
   auto &flash = DataFlashBlockDevice::getInstance();
-  return !flash.erase(0, sizeof(*this)) && !flash.program(this, 0, sizeof(*this)) ? IOret::OK : IOret::ERROR;
+  auto bytes = reinterpret_cast<const uint8_t *>(this);
+  auto eraseSize = flash.get_erase_size(), size = slotSize();
+  uint8_t chunk[64];
+  // compare the config with length bytes at offset in the DataFlash
+  auto equal = [&](uint32_t offset, const uint8_t *data, uint32_t length) {
+    for (uint32_t i = 0; i < length; i += sizeof(chunk)) {
+      auto n = std::min<uint32_t>(sizeof(chunk), length - i);
+      if (flash.read(chunk, offset + i, n) || memcmp(chunk, data + i, n)) return false;
+    }
+    return true;
+  };
+  SlotHeader header;
+  auto current = activeSlot(header);
+  SlotHeader next{SlotHeader::expectedSignature, current < 0 ? 1 : header.sequence + 1, sizeof(*this),
+                  util::crc32(this, sizeof(*this)), 0};
+  next.headerCrc = next.checksum();
+  // nothing changed
+  if (current >= 0 && header.length == next.length && header.crc == next.crc &&
+      equal(current * size + sizeof(SlotHeader), bytes, sizeof(*this)))
+    return IOret::OK;
+  // slot 0 may hold a config saved by older firmware
+  uint32_t slot = current == 1 ? 0 : 1, base = slot * size;
+  if (flash.erase(base, eraseSize)) return IOret::ERROR;
+  for (uint32_t block = 0; block < size; block += eraseSize) {
+    // the range of the config bytes in this block
+    uint32_t start = std::max<uint32_t>(block, sizeof(SlotHeader)) - sizeof(SlotHeader),
+             end = std::min<uint32_t>(block + eraseSize - sizeof(SlotHeader), sizeof(*this));
+    if (start >= end) continue;
+    auto offset = base + sizeof(SlotHeader) + start;
+    if (block && equal(offset, bytes + start, end - start)) continue;
+    if ((block && flash.erase(base + block, eraseSize)) || flash.program(bytes + start, offset, end - start))
+      return IOret::ERROR;
+  }
+  return flash.program(&next, base, sizeof(next)) ? IOret::ERROR : IOret::OK;
 }
 
 template class Config<currentVersion>;